@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SharedResource.h"
+#include "AdaptiveMutex.h"
+#include "QueueMutex.h"
+
+// Measures lock()/lockConst() throughput and latency percentiles of
+// SharedResource over a grid of thread counts, read/write ratios, critical
+// section lengths and Mutex types. Prints one JSON object per line.
+//
+// Usage: shared-resource-bench [--threads N] [--duration-ms MS]
+
+namespace
+{
+    struct Payload
+    {
+        std::uint64_t values[8];
+    };
+
+    struct Config
+    {
+        unsigned                    threads;
+        unsigned                    read_percent;
+        unsigned                    critical_section;
+        std::chrono::milliseconds   duration;
+    };
+
+    struct Result
+    {
+        std::uint64_t   ops;
+        double          ops_per_sec;
+        std::uint64_t   p50_ns;
+        std::uint64_t   p99_ns;
+        std::uint64_t   p999_ns;
+    };
+
+    // Reads or updates the payload for roughly `length` iterations.
+    std::uint64_t readWork(const Payload& payload, unsigned length)
+    {
+        std::uint64_t sum = 0;
+        for (unsigned i = 0; i < length; ++i)
+        {
+            sum += payload.values[i % 8] * 31 + i;
+        }
+        return sum + payload.values[0];
+    }
+
+    void writeWork(Payload& payload, unsigned length)
+    {
+        for (unsigned i = 0; i < length; ++i)
+        {
+            payload.values[i % 8] = payload.values[i % 8] * 31 + i;
+        }
+        ++payload.values[0];
+    }
+
+    std::uint64_t percentile(std::vector<std::uint64_t>& samples, double fraction)
+    {
+        if (samples.empty())
+        {
+            return 0;
+        }
+
+        auto index = static_cast<std::size_t>(fraction * static_cast<double>(samples.size() - 1));
+        std::nth_element(samples.begin(), samples.begin() + static_cast<std::ptrdiff_t>(index), samples.end());
+        return samples[index];
+    }
+
+    template<typename Read, typename Write>
+    Result run(const Config& config, Read read, Write write)
+    {
+        std::atomic<unsigned> ready(0);
+        std::atomic<bool> start(false);
+        std::atomic<bool> stop(false);
+        std::atomic<std::uint64_t> sink(0);
+        std::vector<std::vector<std::uint64_t>> samples(config.threads);
+        std::vector<std::thread> threads;
+
+        for (unsigned t = 0; t < config.threads; ++t)
+        {
+            threads.emplace_back([&, t]()
+            {
+                std::uint64_t rng = 0x9E3779B97F4A7C15ull * (t + 1);
+                std::uint64_t local_sink = 0;
+                auto& latencies = samples[t];
+                latencies.reserve(1 << 20);
+
+                ++ready;
+                while (!start)
+                {
+                    std::this_thread::yield();
+                }
+
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    rng ^= rng << 13;
+                    rng ^= rng >> 7;
+                    rng ^= rng << 17;
+
+                    auto begin = std::chrono::steady_clock::now();
+                    if (rng % 100 < config.read_percent)
+                    {
+                        local_sink += read(config.critical_section);
+                    }
+                    else
+                    {
+                        write(config.critical_section);
+                    }
+                    auto end = std::chrono::steady_clock::now();
+
+                    latencies.push_back(static_cast<std::uint64_t>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()));
+                }
+                sink += local_sink;
+            });
+        }
+
+        while (ready != config.threads)
+        {
+            std::this_thread::yield();
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        start = true;
+        std::this_thread::sleep_for(config.duration);
+        stop = true;
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        std::vector<std::uint64_t> all;
+        for (auto& latencies : samples)
+        {
+            all.insert(all.end(), latencies.begin(), latencies.end());
+        }
+
+        Result result;
+        result.ops = all.size();
+        result.ops_per_sec = static_cast<double>(all.size()) / elapsed;
+        result.p50_ns = percentile(all, 0.50);
+        result.p99_ns = percentile(all, 0.99);
+        result.p999_ns = percentile(all, 0.999);
+        return result;
+    }
+
+    template<typename Mutex>
+    Result runSharedResource(const Config& config)
+    {
+        SharedResource<Payload, Mutex> shared_payload(Payload{});
+        return run(config,
+                   [&shared_payload](unsigned length) { return readWork(*shared_payload.lockConst(), length); },
+                   [&shared_payload](unsigned length) { writeWork(*shared_payload.lock(), length); });
+    }
+
+    Result runRawMutex(const Config& config)
+    {
+        std::mutex mutex;
+        Payload payload{};
+        return run(config,
+                   [&](unsigned length) { std::lock_guard<std::mutex> guard(mutex); return readWork(payload, length); },
+                   [&](unsigned length) { std::lock_guard<std::mutex> guard(mutex); writeWork(payload, length); });
+    }
+
+    void print(const char *mutex, const Config& config, const Result& result)
+    {
+        std::cout << "{\"mutex\":\"" << mutex << "\""
+                  << ",\"threads\":" << config.threads
+                  << ",\"read_percent\":" << config.read_percent
+                  << ",\"critical_section\":" << config.critical_section
+                  << ",\"ops\":" << result.ops
+                  << ",\"ops_per_sec\":" << static_cast<std::uint64_t>(result.ops_per_sec)
+                  << ",\"p50_ns\":" << result.p50_ns
+                  << ",\"p99_ns\":" << result.p99_ns
+                  << ",\"p999_ns\":" << result.p999_ns
+                  << "}" << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::chrono::milliseconds duration(200);
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (std::strcmp(argv[i], "--threads") == 0)
+        {
+            max_threads = static_cast<unsigned>(std::max(1, std::atoi(argv[i + 1])));
+        }
+        else if (std::strcmp(argv[i], "--duration-ms") == 0)
+        {
+            duration = std::chrono::milliseconds(std::max(1, std::atoi(argv[i + 1])));
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--threads N] [--duration-ms MS]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<unsigned> thread_counts;
+    for (unsigned threads = 1; threads < max_threads; threads *= 2)
+    {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(max_threads);
+
+    for (unsigned threads : thread_counts)
+    {
+        for (unsigned read_percent : {0u, 50u, 90u, 99u})
+        {
+            for (unsigned critical_section : {0u, 100u, 1000u})
+            {
+                Config config{threads, read_percent, critical_section, duration};
+
+                print("raw std::mutex", config, runRawMutex(config));
+                print("std::mutex", config, runSharedResource<std::mutex>(config));
+                print("std::recursive_mutex", config, runSharedResource<std::recursive_mutex>(config));
+                print("std::shared_mutex", config, runSharedResource<std::shared_mutex>(config));
+                print("AdaptiveMutex", config, runSharedResource<AdaptiveMutex>(config));
+                print("TicketMutex", config, runSharedResource<TicketMutex>(config));
+                print("ClhMutex", config, runSharedResource<ClhMutex>(config));
+                print("CohortMutex", config, runSharedResource<CohortMutex<>>(config));
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
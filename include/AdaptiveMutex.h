@@ -0,0 +1,169 @@
+#ifndef ADAPTIVE_MUTEX_H
+#define ADAPTIVE_MUTEX_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "SharedResource.h"
+
+// Spin-then-park mutex for short critical sections. A contended lock() first
+// spins with exponential backoff and only then sleeps in the kernel (futex
+// on Linux). The spin budget follows how long recent acquisitions had to
+// spin, which tracks the observed hold time: it grows while spinning pays
+// off and shrinks when the lock is held for longer than spinning can cover.
+//
+// Meets the Lockable requirements, so it works as the Mutex parameter of
+// SharedResource and with std::condition_variable_any.
+class AdaptiveMutex
+{
+public:
+    AdaptiveMutex() noexcept = default;
+    ~AdaptiveMutex() = default;
+
+    AdaptiveMutex(const AdaptiveMutex&) = delete;
+    AdaptiveMutex& operator=(const AdaptiveMutex&) = delete;
+
+    void lock()
+    {
+        if (try_lock())
+        {
+            return;
+        }
+
+        if (spin())
+        {
+            return;
+        }
+
+        park();
+    }
+
+    bool try_lock() noexcept
+    {
+        std::uint32_t expected = Unlocked;
+        return m_state.compare_exchange_strong(expected, Locked, std::memory_order_acquire,
+                                               std::memory_order_relaxed);
+    }
+
+    void unlock() noexcept
+    {
+        if (m_state.exchange(Unlocked, std::memory_order_release) == LockedWithWaiters)
+        {
+            wake();
+        }
+    }
+
+    int spinBudget() const noexcept
+    {
+        return m_spin_budget.load(std::memory_order_relaxed);
+    }
+
+private:
+    enum : std::uint32_t
+    {
+        Unlocked = 0,
+        Locked = 1,
+        LockedWithWaiters = 2
+    };
+
+    static constexpr int minSpinBudget = 16;
+    static constexpr int maxSpinBudget = 4096;
+    static constexpr int maxBackoff = 64;
+
+    bool spin() noexcept
+    {
+        const int budget = spinBudget();
+        int spins = 0;
+        int backoff = 1;
+
+        while (spins < budget)
+        {
+            for (int i = 0; i < backoff; ++i)
+            {
+                shared_resource_detail::cpuRelax();
+            }
+            spins += backoff;
+            backoff = std::min(backoff * 2, maxBackoff);
+
+            if (m_state.load(std::memory_order_relaxed) == Unlocked && try_lock())
+            {
+                adapt(2 * spins);
+                return true;
+            }
+
+            // Somebody is already parked: spinning would only delay them.
+            if (m_state.load(std::memory_order_relaxed) == LockedWithWaiters)
+            {
+                break;
+            }
+        }
+
+        adapt(budget / 2);
+        return false;
+    }
+
+    // Moves the budget an eighth of the way toward the target, the same
+    // smoothing glibc uses for PTHREAD_MUTEX_ADAPTIVE_NP.
+    void adapt(int target) noexcept
+    {
+        const int budget = spinBudget();
+        const int next = budget + (std::clamp(target, minSpinBudget, maxSpinBudget) - budget) / 8;
+        m_spin_budget.store(next, std::memory_order_relaxed);
+    }
+
+    void park()
+    {
+        std::uint32_t state = m_state.exchange(LockedWithWaiters, std::memory_order_acquire);
+        while (state != Unlocked)
+        {
+            sleep();
+            state = m_state.exchange(LockedWithWaiters, std::memory_order_acquire);
+        }
+    }
+
+#if defined(__linux__)
+    void sleep() noexcept
+    {
+        syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&m_state), FUTEX_WAIT_PRIVATE,
+                LockedWithWaiters, nullptr, nullptr, 0);
+    }
+
+    void wake() noexcept
+    {
+        syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&m_state), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+#elif defined(__cpp_lib_atomic_wait)
+    void sleep() noexcept
+    {
+        m_state.wait(LockedWithWaiters, std::memory_order_relaxed);
+    }
+
+    void wake() noexcept
+    {
+        m_state.notify_one();
+    }
+#else
+    void sleep() noexcept
+    {
+        std::this_thread::yield();
+    }
+
+    void wake() noexcept { }
+#endif
+
+    static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t),
+                  "futex needs a plain 32-bit word");
+
+    std::atomic<std::uint32_t>  m_state{Unlocked};
+    std::atomic<int>            m_spin_budget{256};
+};
+
+#endif //ADAPTIVE_MUTEX_H
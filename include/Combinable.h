@@ -0,0 +1,240 @@
+#ifndef COMBINABLE_H
+#define COMBINABLE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "SharedResource.h"
+
+namespace shared_resource_detail
+{
+    // Ids are never reused, so a stale thread-local cache entry of a
+    // destroyed Combinable can never match a live one.
+    inline std::uint64_t nextCombinableId() noexcept
+    {
+        static std::atomic<std::uint64_t> next{1};
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Per-thread replicas of T for aggregate state such as counters and
+// histograms. Each thread updates its own cache-line-aligned replica through
+// local(), and replicas are only reduced when somebody reads via combine().
+//
+// A replica is guarded by a flag of its own, which only combine() ever
+// contends on, so local() stays cheap while combine() still sees every
+// replica in a consistent state. Replicas outlive the threads that created
+// them, so their contributions are never lost.
+template<typename T>
+class Combinable
+{
+    struct alignas(shared_resource_detail::cacheLineSize) Replica : shared_resource_detail::SpinFlag
+    {
+        explicit Replica(const T& identity) : m_value(identity) { }
+
+        T                   m_value;
+        std::thread::id     m_owner = std::this_thread::get_id();
+        Replica             *m_next = nullptr;
+    };
+
+public:
+    // New replicas and every combine() start out as copies of identity.
+    explicit Combinable(T identity = T()) :
+        m_identity(std::move(identity)),
+        m_id(shared_resource_detail::nextCombinableId()) { }
+
+    ~Combinable()
+    {
+        auto replica = m_replicas.load(std::memory_order_acquire);
+        while (replica)
+        {
+            delete std::exchange(replica, replica->m_next);
+        }
+    }
+
+    Combinable(Combinable&&) = delete;
+    Combinable(const Combinable&) = delete;
+    Combinable& operator=(Combinable&&) = delete;
+    Combinable& operator=(const Combinable&) = delete;
+
+    class LocalAccessor
+    {
+        friend class Combinable<T>;
+    public:
+        ~LocalAccessor()
+        {
+            if (m_replica)
+            {
+                m_replica->release();
+            }
+        }
+
+        LocalAccessor(const LocalAccessor&) = delete;
+        LocalAccessor& operator=(const LocalAccessor&) = delete;
+
+        LocalAccessor(LocalAccessor&& a) noexcept : m_replica(std::exchange(a.m_replica, nullptr)) { }
+
+        LocalAccessor& operator=(LocalAccessor&& a) noexcept
+        {
+            if (&a != this)
+            {
+                if (m_replica)
+                {
+                    m_replica->release();
+                }
+                m_replica = std::exchange(a.m_replica, nullptr);
+            }
+            return *this;
+        }
+
+        bool isValid() const noexcept
+        {
+            return m_replica != nullptr;
+        }
+
+        T* operator->()
+        {
+            return &m_replica->m_value;
+        }
+
+        T& operator*()
+        {
+            return m_replica->m_value;
+        }
+
+    private:
+        explicit LocalAccessor(Replica *replica) noexcept : m_replica(replica)
+        {
+            m_replica->acquire();
+        }
+
+        Replica *m_replica;
+    };
+
+    // Result of combine(): owns the reduced value.
+    class ConstAccessor
+    {
+        friend class Combinable<T>;
+    public:
+        bool isValid() const noexcept
+        {
+            return true;
+        }
+
+        const T* operator->() const
+        {
+            return &m_value;
+        }
+
+        const T& operator*() const
+        {
+            return m_value;
+        }
+
+    private:
+        explicit ConstAccessor(T&& value) : m_value(std::move(value)) { }
+
+        T m_value;
+    };
+
+    // The calling thread's replica, created on first use.
+    LocalAccessor local()
+    {
+        return LocalAccessor(&replica());
+    }
+
+    // Folds every replica into a copy of the identity with
+    // reducer(T& accumulator, const T& replica). All replicas are held at
+    // once, so the result is a consistent cut across threads. The calling
+    // thread must not hold its own LocalAccessor meanwhile.
+    template<typename Reducer>
+    ConstAccessor combine(Reducer reducer) const
+    {
+        std::vector<Replica*> replicas;
+        for (auto replica = m_replicas.load(std::memory_order_acquire); replica; replica = replica->m_next)
+        {
+            replica->acquire();
+            replicas.push_back(replica);
+        }
+
+        T result(m_identity);
+        try
+        {
+            for (auto replica : replicas)
+            {
+                std::invoke(reducer, result, static_cast<const T&>(replica->m_value));
+            }
+        }
+        catch (...)
+        {
+            releaseAll(replicas);
+            throw;
+        }
+
+        releaseAll(replicas);
+        return ConstAccessor(std::move(result));
+    }
+
+private:
+    struct CacheEntry
+    {
+        std::uint64_t   m_id = 0;
+        Replica         *m_replica = nullptr;
+    };
+
+    static constexpr std::size_t cacheSize = 8;
+
+    Replica& replica()
+    {
+        thread_local std::array<CacheEntry, cacheSize> cache;
+
+        auto& entry = cache[m_id % cacheSize];
+        if (entry.m_id != m_id)
+        {
+            entry.m_replica = &findOrCreate();
+            entry.m_id = m_id;
+        }
+        return *entry.m_replica;
+    }
+
+    Replica& findOrCreate()
+    {
+        const auto self = std::this_thread::get_id();
+        auto head = m_replicas.load(std::memory_order_acquire);
+        for (auto replica = head; replica; replica = replica->m_next)
+        {
+            if (replica->m_owner == self)
+            {
+                return *replica;
+            }
+        }
+
+        // Only this thread ever adds a replica owned by it, so nobody can
+        // insert a duplicate meanwhile.
+        auto created = new Replica(m_identity);
+        created->m_next = head;
+        while (!m_replicas.compare_exchange_weak(created->m_next, created, std::memory_order_acq_rel,
+                                                 std::memory_order_acquire)) { }
+        return *created;
+    }
+
+    static void releaseAll(const std::vector<Replica*>& replicas) noexcept
+    {
+        for (auto replica : replicas)
+        {
+            replica->release();
+        }
+    }
+
+    const T                 m_identity;
+    const std::uint64_t     m_id;
+    std::atomic<Replica*>   m_replicas{nullptr};
+};
+
+#endif //COMBINABLE_H
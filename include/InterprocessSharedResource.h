@@ -0,0 +1,331 @@
+#ifndef INTERPROCESS_SHARED_RESOURCE_H
+#define INTERPROCESS_SHARED_RESOURCE_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// SharedResource whose T lives in POSIX shared memory together with a
+// process-shared robust mutex, so several processes work on one copy.
+//
+// A named resource is backed by shm_open(name): the first process to open
+// it constructs T from the given arguments, later ones attach to the
+// existing segment. Opening is serialized with flock(), which the kernel
+// releases if the holder dies, so if the creator dies or throws half way
+// the next process to open the segment initializes it instead of waiting
+// forever. Without a name the segment is an anonymous shared mapping that
+// is inherited by children forked afterwards. The segment outlives the
+// objects mapping it; remove() unlinks a named one.
+//
+// If a process dies while holding the lock, the next locker still gets it,
+// with ownerDied() set on its accessor. It should then repair T and call
+// markConsistent(); otherwise the mutex becomes unusable and every later
+// lock attempt throws.
+//
+// T is mapped at different addresses in different processes, so it must be
+// trivially copyable and must not hold pointers.
+template<typename T>
+class InterprocessSharedResource
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "InterprocessSharedResource needs a trivially copyable T without pointers");
+
+    // A fresh segment is zero filled, so it starts out Uninitialized.
+    enum : std::uint32_t
+    {
+        Uninitialized = 0,
+        Ready = 1
+    };
+
+    struct Segment
+    {
+        std::atomic<std::uint32_t>  m_state;
+        pthread_mutex_t             m_mutex;
+        T                           m_resource;
+    };
+
+    static_assert(std::atomic<std::uint32_t>::is_always_lock_free,
+                  "the segment state has to work across processes");
+
+public:
+    template<typename ...Args>
+    explicit InterprocessSharedResource(const char *name, Args&& ...args)
+    {
+        if (name)
+        {
+            FileLock file_lock(openNamed(name));
+            map(file_lock.fd());
+            construct(std::forward<Args>(args)...);
+        }
+        else
+        {
+            openAnonymous();
+            construct(std::forward<Args>(args)...);
+        }
+    }
+
+    ~InterprocessSharedResource()
+    {
+        munmap(m_segment, sizeof(Segment));
+    }
+
+    InterprocessSharedResource(InterprocessSharedResource&&) = delete;
+    InterprocessSharedResource(const InterprocessSharedResource&) = delete;
+    InterprocessSharedResource& operator=(InterprocessSharedResource&&) = delete;
+    InterprocessSharedResource& operator=(const InterprocessSharedResource&) = delete;
+
+    // Unlinks a named segment. Processes that have it mapped keep using it.
+    static bool remove(const char *name) noexcept
+    {
+        return shm_unlink(name) == 0;
+    }
+
+    template<typename U>
+    class BasicAccessor
+    {
+        friend class InterprocessSharedResource<T>;
+    public:
+        ~BasicAccessor()
+        {
+            unlock();
+        }
+
+        BasicAccessor(const BasicAccessor&) = delete;
+        BasicAccessor& operator=(const BasicAccessor&) = delete;
+
+        BasicAccessor(BasicAccessor&& a) noexcept :
+            m_segment(std::exchange(a.m_segment, nullptr)),
+            m_owner_died(a.m_owner_died) { }
+
+        BasicAccessor& operator=(BasicAccessor&& a) noexcept
+        {
+            if (&a != this)
+            {
+                unlock();
+                m_segment = std::exchange(a.m_segment, nullptr);
+                m_owner_died = a.m_owner_died;
+            }
+            return *this;
+        }
+
+        bool isValid() const noexcept
+        {
+            return m_segment != nullptr;
+        }
+
+        U* operator->() const
+        {
+            return &m_segment->m_resource;
+        }
+
+        U& operator*() const
+        {
+            return m_segment->m_resource;
+        }
+
+        // The previous owner died while holding the lock, so the resource
+        // may be half updated.
+        bool ownerDied() const noexcept
+        {
+            return m_owner_died;
+        }
+
+        void markConsistent()
+        {
+            if (m_owner_died)
+            {
+                check(pthread_mutex_consistent(&m_segment->m_mutex));
+                m_owner_died = false;
+            }
+        }
+
+    private:
+        BasicAccessor(Segment *segment, bool owner_died) noexcept :
+            m_segment(segment),
+            m_owner_died(owner_died) { }
+
+        void unlock() noexcept
+        {
+            if (m_segment)
+            {
+                pthread_mutex_unlock(&m_segment->m_mutex);
+                m_segment = nullptr;
+            }
+        }
+
+        Segment *m_segment;
+        bool    m_owner_died;
+    };
+
+    using Accessor = BasicAccessor<T>;
+    using ConstAccessor = BasicAccessor<const T>;
+
+    Accessor lock()
+    {
+        return Accessor(m_segment, lockMutex(pthread_mutex_lock(&m_segment->m_mutex)));
+    }
+
+    // Robust mutexes have no shared mode, so readers are exclusive as well.
+    ConstAccessor lockConst() const
+    {
+        return ConstAccessor(m_segment, lockMutex(pthread_mutex_lock(&m_segment->m_mutex)));
+    }
+
+    Accessor tryLock()
+    {
+        const int result = pthread_mutex_trylock(&m_segment->m_mutex);
+        if (result == EBUSY)
+        {
+            return Accessor(nullptr, false);
+        }
+        return Accessor(m_segment, lockMutex(result));
+    }
+
+private:
+    static void check(int result)
+    {
+        if (result != 0)
+        {
+            throw std::system_error(result, std::generic_category());
+        }
+    }
+
+    // Returns whether the previous owner died.
+    static bool lockMutex(int result)
+    {
+        if (result == EOWNERDEAD)
+        {
+            return true;
+        }
+        check(result);
+        return false;
+    }
+
+    // Holds flock() on a shared memory object and closes it when done. The
+    // mapping keeps the open file description alive, so closing alone would
+    // not release the lock.
+    class FileLock
+    {
+    public:
+        explicit FileLock(int fd) : m_fd(fd)
+        {
+            while (flock(m_fd, LOCK_EX) != 0)
+            {
+                if (errno != EINTR)
+                {
+                    const int error = errno;
+                    close(m_fd);
+                    check(error);
+                }
+            }
+        }
+
+        ~FileLock()
+        {
+            flock(m_fd, LOCK_UN);
+            close(m_fd);
+        }
+
+        FileLock(const FileLock&) = delete;
+        FileLock& operator=(const FileLock&) = delete;
+
+        int fd() const noexcept
+        {
+            return m_fd;
+        }
+
+    private:
+        const int m_fd;
+    };
+
+    static int openNamed(const char *name)
+    {
+        const int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+        if (fd == -1)
+        {
+            check(errno);
+        }
+        return fd;
+    }
+
+    // Called with the FileLock held, so whoever gets here first sizes the
+    // segment and nobody sees it half sized.
+    void map(int fd)
+    {
+        struct stat status;
+        if (fstat(fd, &status) != 0 ||
+            (static_cast<std::size_t>(status.st_size) < sizeof(Segment) && ftruncate(fd, sizeof(Segment)) != 0))
+        {
+            check(errno);
+        }
+
+        void *address = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED)
+        {
+            check(errno);
+        }
+        m_segment = static_cast<Segment*>(address);
+    }
+
+    void openAnonymous()
+    {
+        void *address = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (address == MAP_FAILED)
+        {
+            check(errno);
+        }
+        m_segment = static_cast<Segment*>(address);
+    }
+
+    // A segment left uninitialized by a creator that died or threw is set
+    // up again by the next process to open it.
+    template<typename ...Args>
+    void construct(Args&& ...args)
+    {
+        if (m_segment->m_state.load(std::memory_order_acquire) == Ready)
+        {
+            return;
+        }
+
+        try
+        {
+            initialize(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            munmap(m_segment, sizeof(Segment));
+            throw;
+        }
+    }
+
+    template<typename ...Args>
+    void initialize(Args&& ...args)
+    {
+        pthread_mutexattr_t attributes;
+        check(pthread_mutexattr_init(&attributes));
+        pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+        const int result = pthread_mutex_init(&m_segment->m_mutex, &attributes);
+        pthread_mutexattr_destroy(&attributes);
+        check(result);
+
+        new (&m_segment->m_resource) T(std::forward<Args>(args)...);
+        m_segment->m_state.store(Ready, std::memory_order_release);
+    }
+
+    Segment *m_segment = nullptr;
+};
+
+#endif //INTERPROCESS_SHARED_RESOURCE_H
@@ -0,0 +1,242 @@
+#ifndef LEFT_RIGHT_SHARED_RESOURCE_H
+#define LEFT_RIGHT_SHARED_RESOURCE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "SharedResource.h"
+
+namespace shared_resource_detail
+{
+    // Striped count of readers inside one side of a LeftRightSharedResource.
+    // Each reader bumps the stripe picked by its thread, so readers on
+    // different cores don't bounce a shared counter.
+    class ReadIndicator
+    {
+    public:
+        std::atomic<std::ptrdiff_t>& arrive() noexcept
+        {
+            auto& counter = m_stripes[threadSlotHint() % stripeCount].m_counter;
+            counter.fetch_add(1, std::memory_order_seq_cst);
+            return counter;
+        }
+
+        static void depart(std::atomic<std::ptrdiff_t>& counter) noexcept
+        {
+            counter.fetch_sub(1, std::memory_order_release);
+        }
+
+        bool isEmpty() const noexcept
+        {
+            for (auto& stripe : m_stripes)
+            {
+                if (stripe.m_counter.load(std::memory_order_acquire) != 0)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void waitEmpty() const noexcept
+        {
+            for (unsigned spins = 0; !isEmpty(); ++spins)
+            {
+                if (spins < 64)
+                {
+                    cpuRelax();
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+    private:
+        static constexpr std::size_t stripeCount = 16;
+
+        struct alignas(cacheLineSize) Stripe
+        {
+            std::atomic<std::ptrdiff_t> m_counter{0};
+        };
+
+        std::array<Stripe, stripeCount> m_stripes;
+    };
+}
+
+// Left-right flavour of SharedResource for large read-mostly data. Two
+// instances of T are kept: readers always find one of them that no writer is
+// touching, so they never block, never retry and never allocate. Writers are
+// serialized by Mutex and apply every mutation twice through modify(), once
+// per instance, waiting for the readers of an instance to drain before
+// touching it. The mutation therefore has to be deterministic, so that both
+// instances end up equal.
+template<typename T, typename Mutex = std::mutex>
+class LeftRightSharedResource
+{
+public:
+    // Both instances are constructed from the same arguments.
+    template<typename ...Args>
+    LeftRightSharedResource(const Args& ...args) : m_left(args...), m_right(args...) { }
+
+    ~LeftRightSharedResource() = default;
+    LeftRightSharedResource(LeftRightSharedResource&&) = delete;
+    LeftRightSharedResource(const LeftRightSharedResource&) = delete;
+    LeftRightSharedResource& operator=(LeftRightSharedResource&&) = delete;
+    LeftRightSharedResource& operator=(const LeftRightSharedResource&) = delete;
+
+    class ConstAccessor
+    {
+        friend class LeftRightSharedResource<T, Mutex>;
+    public:
+        ~ConstAccessor()
+        {
+            if (m_indicator)
+            {
+                shared_resource_detail::ReadIndicator::depart(*m_indicator);
+            }
+        }
+
+        ConstAccessor(const ConstAccessor&) = delete;
+        ConstAccessor& operator=(const ConstAccessor&) = delete;
+
+        ConstAccessor(ConstAccessor&& a) noexcept :
+            m_indicator(a.m_indicator),
+            m_shared_resource(a.m_shared_resource)
+        {
+            a.m_indicator = nullptr;
+            a.m_shared_resource = nullptr;
+        }
+
+        ConstAccessor& operator=(ConstAccessor&& a) noexcept
+        {
+            if (&a != this)
+            {
+                if (m_indicator)
+                {
+                    shared_resource_detail::ReadIndicator::depart(*m_indicator);
+                }
+                m_indicator = a.m_indicator;
+                m_shared_resource = a.m_shared_resource;
+                a.m_indicator = nullptr;
+                a.m_shared_resource = nullptr;
+            }
+            return *this;
+        }
+
+        bool isValid() const noexcept
+        {
+            return m_shared_resource != nullptr;
+        }
+
+        const T* operator->() const
+        {
+            return m_shared_resource;
+        }
+
+        const T& operator*() const
+        {
+            return *m_shared_resource;
+        }
+
+    private:
+        explicit ConstAccessor(const LeftRightSharedResource<T, Mutex> *resource) :
+            m_indicator(&resource->m_indicators[resource->m_version_index.load(std::memory_order_seq_cst)].arrive()),
+            m_shared_resource(&resource->instance(resource->m_left_right.load(std::memory_order_seq_cst))) { }
+
+        std::atomic<std::ptrdiff_t>     *m_indicator;
+        const T                         *m_shared_resource;
+    };
+
+    // Wait-free: registers with a read indicator and picks the instance that
+    // writers currently leave alone.
+    ConstAccessor lockConst() const
+    {
+        return ConstAccessor(this);
+    }
+
+    template<typename Func>
+    auto read(Func func) const
+    {
+        using Result = std::invoke_result_t<Func, const T&>;
+        static_assert(!std::is_reference<Result>::value,
+                      "read() returns by value, the instance may change once it returns");
+
+        auto accessor = lockConst();
+        return std::invoke(func, *accessor);
+    }
+
+    // Applies func(T&) to the instance readers are not using, moves readers
+    // over to it, waits for the stragglers on the old instance and replays
+    // func on that one too. If func throws, the instance it was applied to
+    // is overwritten with the other one before the exception propagates, so
+    // both instances stay equal: the first call leaves the old value in
+    // place, the replay keeps the new one readers already see.
+    template<typename Func>
+    void modify(Func func)
+    {
+        std::lock_guard<Mutex> lock(m_mutex);
+
+        const auto left_right = m_left_right.load(std::memory_order_relaxed);
+        applyOrRestore(func, 1 - left_right);
+        m_left_right.store(1 - left_right, std::memory_order_seq_cst);
+
+        toggleVersionAndWait();
+
+        applyOrRestore(func, left_right);
+    }
+
+private:
+    T& instance(int index) noexcept
+    {
+        return index ? m_right : m_left;
+    }
+
+    const T& instance(int index) const noexcept
+    {
+        return index ? m_right : m_left;
+    }
+
+    // Only called on the instance no reader can see.
+    template<typename Func>
+    void applyOrRestore(Func& func, int index)
+    {
+        try
+        {
+            std::invoke(func, instance(index));
+        }
+        catch (...)
+        {
+            instance(index) = instance(1 - index);
+            throw;
+        }
+    }
+
+    // Once both indicators have been seen empty, no reader can still be
+    // looking at the instance the writer is about to touch.
+    void toggleVersionAndWait()
+    {
+        const auto previous = m_version_index.load(std::memory_order_relaxed);
+        const auto next = 1 - previous;
+
+        m_indicators[next].waitEmpty();
+        m_version_index.store(next, std::memory_order_seq_cst);
+        m_indicators[previous].waitEmpty();
+    }
+
+    T                                                       m_left;
+    T                                                       m_right;
+    alignas(shared_resource_detail::cacheLineSize) std::atomic<int> m_left_right{0};
+    std::atomic<int>                                        m_version_index{0};
+    mutable std::array<shared_resource_detail::ReadIndicator, 2> m_indicators;
+    Mutex                                                   m_mutex;
+};
+
+#endif //LEFT_RIGHT_SHARED_RESOURCE_H
@@ -0,0 +1,218 @@
+#ifndef LOCK_STATS_H
+#define LOCK_STATS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class LockStats;
+
+// Process-wide list of live LockStats instances, so lock hot spots can be
+// dumped without knowing every SharedResource in advance.
+class LockStatsRegistry
+{
+    friend class LockStats;
+public:
+    static LockStatsRegistry& instance()
+    {
+        static LockStatsRegistry registry;
+        return registry;
+    }
+
+    LockStatsRegistry(const LockStatsRegistry&) = delete;
+    LockStatsRegistry& operator=(const LockStatsRegistry&) = delete;
+
+    // Writes {"resources":[...]} with one object per registered instance.
+    inline void dump(std::ostream& out) const;
+
+private:
+    LockStatsRegistry() = default;
+
+    void add(const LockStats *stats)
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_stats.push_back(stats);
+    }
+
+    void remove(const LockStats *stats)
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_stats.erase(std::remove(m_stats.begin(), m_stats.end(), stats), m_stats.end());
+    }
+
+    mutable std::mutex              m_mutex;
+    std::vector<const LockStats*>   m_stats;
+};
+
+// Log2 histogram of durations in nanoseconds. Bucket i counts samples in
+// [2^(i-1), 2^i) ns; the last bucket also takes everything longer.
+class LockHistogram
+{
+public:
+    static constexpr std::size_t bucketCount = 40;
+
+    void record(std::chrono::nanoseconds duration) noexcept
+    {
+        const auto ns = static_cast<std::uint64_t>(std::max<std::chrono::nanoseconds::rep>(duration.count(), 0));
+
+        std::size_t bucket = 0;
+        for (std::uint64_t value = ns; value != 0 && bucket + 1 < bucketCount; value >>= 1)
+        {
+            ++bucket;
+        }
+
+        m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    std::uint64_t count() const noexcept
+    {
+        return m_count.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t sum() const noexcept
+    {
+        return m_sum.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t bucket(std::size_t index) const noexcept
+    {
+        return m_buckets[index].load(std::memory_order_relaxed);
+    }
+
+    void dump(std::ostream& out) const
+    {
+        out << "{\"count\":" << count() << ",\"sum\":" << sum() << ",\"buckets\":[";
+        for (std::size_t i = 0; i < bucketCount; ++i)
+        {
+            out << (i ? "," : "") << bucket(i);
+        }
+        out << "]}";
+    }
+
+private:
+    std::array<std::atomic<std::uint64_t>, bucketCount> m_buckets{};
+    std::atomic<std::uint64_t>                          m_count{0};
+    std::atomic<std::uint64_t>                          m_sum{0};
+};
+
+// Instrumentation policy for SharedResource:
+//
+//     SharedResource<Config, std::shared_mutex, LockStats> config;
+//     config.setName("config");
+//     ...
+//     LockStatsRegistry::instance().dump(std::cout);
+//
+// Wait time is measured inside lock()/lockConst(); hold time runs from
+// accessor construction to release, minus time spent in condvar waits.
+class LockStats
+{
+public:
+    static constexpr bool enabled = true;
+
+    LockStats()
+    {
+        LockStatsRegistry::instance().add(this);
+    }
+
+    ~LockStats()
+    {
+        LockStatsRegistry::instance().remove(this);
+    }
+
+    LockStats(const LockStats&) = delete;
+    LockStats& operator=(const LockStats&) = delete;
+
+    void setName(const char *name) const
+    {
+        std::lock_guard<std::mutex> guard(LockStatsRegistry::instance().m_mutex);
+        m_name = name;
+    }
+
+    void recordAcquisition(bool contended, std::chrono::nanoseconds wait) const noexcept
+    {
+        m_acquisitions.fetch_add(1, std::memory_order_relaxed);
+        if (contended)
+        {
+            m_contended.fetch_add(1, std::memory_order_relaxed);
+            m_wait.record(wait);
+        }
+    }
+
+    void recordHold(std::chrono::nanoseconds hold) const noexcept
+    {
+        m_hold.record(hold);
+    }
+
+    std::uint64_t acquisitions() const noexcept
+    {
+        return m_acquisitions.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t contendedAcquisitions() const noexcept
+    {
+        return m_contended.load(std::memory_order_relaxed);
+    }
+
+    const LockHistogram& waitTime() const noexcept
+    {
+        return m_wait;
+    }
+
+    const LockHistogram& holdTime() const noexcept
+    {
+        return m_hold;
+    }
+
+private:
+    friend class LockStatsRegistry;
+
+    // Called with the registry mutex held, which also guards m_name.
+    void dump(std::ostream& out) const
+    {
+        out << "{\"name\":\"";
+        for (char c : m_name)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out << '\\';
+            }
+            out << c;
+        }
+        out << "\",\"acquisitions\":" << acquisitions()
+            << ",\"contended\":" << contendedAcquisitions()
+            << ",\"wait_ns\":";
+        m_wait.dump(out);
+        out << ",\"hold_ns\":";
+        m_hold.dump(out);
+        out << "}";
+    }
+
+    mutable std::string                 m_name;
+    mutable std::atomic<std::uint64_t>  m_acquisitions{0};
+    mutable std::atomic<std::uint64_t>  m_contended{0};
+    mutable LockHistogram               m_wait;
+    mutable LockHistogram               m_hold;
+};
+
+void LockStatsRegistry::dump(std::ostream& out) const
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    out << "{\"resources\":[";
+    for (std::size_t i = 0; i < m_stats.size(); ++i)
+    {
+        out << (i ? "," : "");
+        m_stats[i]->dump(out);
+    }
+    out << "]}";
+}
+
+#endif //LOCK_STATS_H
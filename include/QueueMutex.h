@@ -0,0 +1,350 @@
+#ifndef QUEUE_MUTEX_H
+#define QUEUE_MUTEX_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "SharedResource.h"
+
+// Fair FIFO mutexes for heavily contended resources: the lock is granted in
+// arrival order, so no thread can be starved by others that keep reacquiring
+// it. All of them meet the Lockable requirements and work as the Mutex
+// parameter of SharedResource and with std::condition_variable_any.
+//
+// Waiters spin briefly and then yield, since a strict handoff order only
+// makes progress when the next thread in line gets to run.
+
+namespace shared_resource_detail
+{
+    class QueueBackoff
+    {
+    public:
+        void pause() noexcept
+        {
+            if (m_spins < maxSpins)
+            {
+                ++m_spins;
+                cpuRelax();
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+
+    private:
+        static constexpr unsigned maxSpins = 64;
+
+        unsigned m_spins = 0;
+    };
+}
+
+// Ticket lock: lock() draws a ticket and waits until it is served.
+class TicketMutex
+{
+public:
+    TicketMutex() noexcept = default;
+    ~TicketMutex() = default;
+
+    TicketMutex(const TicketMutex&) = delete;
+    TicketMutex& operator=(const TicketMutex&) = delete;
+
+    void lock() noexcept
+    {
+        const auto ticket = m_next.fetch_add(1, std::memory_order_relaxed);
+        shared_resource_detail::QueueBackoff backoff;
+        while (m_serving.load(std::memory_order_acquire) != ticket)
+        {
+            backoff.pause();
+        }
+    }
+
+    bool try_lock() noexcept
+    {
+        auto serving = m_serving.load(std::memory_order_acquire);
+        auto expected = serving;
+        return m_next.compare_exchange_strong(expected, serving + 1, std::memory_order_acquire,
+                                              std::memory_order_relaxed);
+    }
+
+    void unlock() noexcept
+    {
+        m_serving.store(m_serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Number of threads waiting behind the current owner.
+    std::uint32_t waiting() const noexcept
+    {
+        const auto waiting = m_next.load(std::memory_order_relaxed) - m_serving.load(std::memory_order_relaxed);
+        return waiting ? waiting - 1 : 0;
+    }
+
+private:
+    alignas(shared_resource_detail::cacheLineSize) std::atomic<std::uint32_t> m_next{0};
+    alignas(shared_resource_detail::cacheLineSize) std::atomic<std::uint32_t> m_serving{0};
+};
+
+// CLH queue lock. Every waiter spins on its predecessor's node, which sits on
+// a cache line of its own, so a release only invalidates the line of the
+// next thread in line instead of every waiter's. Nodes migrate: a new owner
+// keeps its predecessor's node for its next acquisition.
+//
+// The tail is null while nobody holds or waits for the lock, so try_lock()
+// only has to swing it from null to its own node and never touches a node
+// that another thread may recycle meanwhile.
+class ClhMutex
+{
+public:
+    ClhMutex() noexcept = default;
+    ~ClhMutex() = default;
+
+    ClhMutex(const ClhMutex&) = delete;
+    ClhMutex& operator=(const ClhMutex&) = delete;
+
+    void lock()
+    {
+        auto node = spareNode().take();
+        node->m_locked.store(true, std::memory_order_relaxed);
+
+        auto predecessor = m_tail.exchange(node, std::memory_order_acq_rel);
+        if (predecessor)
+        {
+            waitFor(predecessor);
+            spareNode().give(predecessor);
+        }
+        m_owner = node;
+    }
+
+    bool try_lock()
+    {
+        if (m_tail.load(std::memory_order_relaxed) != nullptr)
+        {
+            return false;
+        }
+
+        auto node = spareNode().take();
+        node->m_locked.store(true, std::memory_order_relaxed);
+
+        Node *expected = nullptr;
+        if (!m_tail.compare_exchange_strong(expected, node, std::memory_order_acquire,
+                                            std::memory_order_relaxed))
+        {
+            spareNode().give(node);
+            return false;
+        }
+
+        m_owner = node;
+        return true;
+    }
+
+    // Without a successor the node is taken back; otherwise the successor,
+    // which spins on it, inherits it.
+    void unlock() noexcept
+    {
+        auto node = m_owner;
+        auto expected = node;
+        if (m_tail.compare_exchange_strong(expected, nullptr, std::memory_order_release,
+                                           std::memory_order_relaxed))
+        {
+            spareNode().give(node);
+            return;
+        }
+        node->m_locked.store(false, std::memory_order_release);
+    }
+
+private:
+    struct alignas(shared_resource_detail::cacheLineSize) Node
+    {
+        std::atomic<bool> m_locked{false};
+    };
+
+    // One cached node per thread, shared by all ClhMutex instances.
+    struct SpareNode
+    {
+        ~SpareNode()
+        {
+            delete m_node;
+        }
+
+        Node* take()
+        {
+            auto node = m_node ? m_node : new Node();
+            m_node = nullptr;
+            return node;
+        }
+
+        void give(Node *node) noexcept
+        {
+            delete m_node;
+            m_node = node;
+        }
+
+        Node *m_node = nullptr;
+    };
+
+    static SpareNode& spareNode() noexcept
+    {
+        thread_local SpareNode spare;
+        return spare;
+    }
+
+    static void waitFor(Node *predecessor) noexcept
+    {
+        shared_resource_detail::QueueBackoff backoff;
+        while (predecessor->m_locked.load(std::memory_order_acquire))
+        {
+            backoff.pause();
+        }
+    }
+
+    alignas(shared_resource_detail::cacheLineSize) std::atomic<Node*> m_tail{nullptr};
+    Node *m_owner = nullptr;
+};
+
+// NUMA-aware cohort lock. Threads first queue on a ticket lock of their own
+// cohort and only the cohort's first owner takes the global lock. On release
+// the lock is handed to a waiter of the same cohort while one exists, keeping
+// the resource in that node's caches, up to maxHandoffs times in a row so
+// other cohorts are not starved.
+//
+// Cohorts are NUMA nodes. On a single node machine, or where the node is
+// unknown, they fall back to groups of CpusPerCohort consecutive CPU ids.
+template<unsigned CpusPerCohort = 4>
+class CohortMutex
+{
+    static_assert(CpusPerCohort > 0, "CohortMutex needs at least one CPU per cohort");
+
+public:
+    static constexpr std::size_t maxCohorts = 8;
+    static constexpr std::uint32_t maxHandoffs = 64;
+
+    CohortMutex() noexcept = default;
+    ~CohortMutex() = default;
+
+    CohortMutex(const CohortMutex&) = delete;
+    CohortMutex& operator=(const CohortMutex&) = delete;
+
+    void lock() noexcept
+    {
+        auto& cohort = m_cohorts[cohortIndex()];
+        cohort.m_local.lock();
+        if (!cohort.m_global_owned)
+        {
+            m_global.lock();
+            cohort.m_global_owned = true;
+        }
+        m_owner = &cohort;
+    }
+
+    bool try_lock() noexcept
+    {
+        auto& cohort = m_cohorts[cohortIndex()];
+        if (!cohort.m_local.try_lock())
+        {
+            return false;
+        }
+
+        if (!cohort.m_global_owned)
+        {
+            if (!m_global.try_lock())
+            {
+                cohort.m_local.unlock();
+                return false;
+            }
+            cohort.m_global_owned = true;
+        }
+        m_owner = &cohort;
+        return true;
+    }
+
+    void unlock() noexcept
+    {
+        auto& cohort = *m_owner;
+        if (cohort.m_local.waiting() != 0 && cohort.m_handoffs < maxHandoffs)
+        {
+            ++cohort.m_handoffs;
+        }
+        else
+        {
+            cohort.m_handoffs = 0;
+            cohort.m_global_owned = false;
+            m_global.unlock();
+        }
+        cohort.m_local.unlock();
+    }
+
+    // Cohort the calling thread queues on.
+    static std::size_t cohortIndex() noexcept
+    {
+        const auto location = currentLocation();
+        if (location.m_node_known)
+        {
+            return location.m_node % maxCohorts;
+        }
+        return (location.m_cpu / CpusPerCohort) % maxCohorts;
+    }
+
+private:
+    // Everything but m_local is only touched by the holder of m_local.
+    struct Cohort
+    {
+        TicketMutex     m_local;
+        bool            m_global_owned = false;
+        std::uint32_t   m_handoffs = 0;
+    };
+
+    struct Location
+    {
+        unsigned    m_cpu = 0;
+        unsigned    m_node = 0;
+        bool        m_node_known = false;
+    };
+
+    // Threads rarely migrate, so the location is only refreshed every so
+    // many acquisitions to keep getcpu off the fast path.
+    static Location currentLocation() noexcept
+    {
+        thread_local Location location;
+        thread_local unsigned until_refresh = 0;
+
+        if (until_refresh-- == 0)
+        {
+            until_refresh = 63;
+#if defined(__linux__) && defined(SYS_getcpu)
+            unsigned cpu = 0;
+            unsigned node = 0;
+            if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+            {
+                location.m_cpu = cpu;
+                location.m_node = node;
+                location.m_node_known = multipleNodes();
+            }
+#endif
+        }
+        return location;
+    }
+
+    static bool multipleNodes() noexcept
+    {
+#if defined(__linux__)
+        static const bool multiple = access("/sys/devices/system/node/node1", F_OK) == 0;
+        return multiple;
+#else
+        return false;
+#endif
+    }
+
+    TicketMutex                         m_global;
+    std::array<Cohort, maxCohorts>      m_cohorts;
+    Cohort                              *m_owner = nullptr;
+};
+
+#endif //QUEUE_MUTEX_H
@@ -0,0 +1,127 @@
+#ifndef RCU_SHARED_RESOURCE_H
+#define RCU_SHARED_RESOURCE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#if __has_include(<version>)
+#include <version>
+#endif
+
+// Read-copy-update flavour of SharedResource for read-mostly data. Readers
+// take an immutable snapshot without touching the writers' mutex; writers
+// edit a private copy through an Accessor, which is published atomically
+// when the Accessor is released. Old snapshots stay valid for as long as a
+// reader holds them.
+template<typename T, typename Mutex = std::mutex>
+class RcuSharedResource
+{
+public:
+    using Snapshot = std::shared_ptr<const T>;
+
+    template<typename ...Args>
+    RcuSharedResource(Args&& ...args) : m_current(std::make_shared<const T>(std::forward<Args>(args)...)) { }
+
+    ~RcuSharedResource() = default;
+    RcuSharedResource(RcuSharedResource&&) = delete;
+    RcuSharedResource(const RcuSharedResource&) = delete;
+    RcuSharedResource& operator=(RcuSharedResource&&) = delete;
+    RcuSharedResource& operator=(const RcuSharedResource&) = delete;
+
+    class Accessor
+    {
+        friend class RcuSharedResource<T, Mutex>;
+    public:
+        ~Accessor()
+        {
+            publish();
+        }
+
+        Accessor(const Accessor&) = delete;
+        Accessor& operator=(const Accessor&) = delete;
+
+        Accessor(Accessor&& a) = default;
+
+        Accessor& operator=(Accessor&& a)
+        {
+            if (&a != this)
+            {
+                publish();
+                m_lock = std::move(a.m_lock);
+                m_shared_resource = a.m_shared_resource;
+                m_draft = std::move(a.m_draft);
+            }
+            return *this;
+        }
+
+        bool isValid() const noexcept
+        {
+            return m_draft != nullptr;
+        }
+
+        T* operator->()
+        {
+            return m_draft.get();
+        }
+
+        T& operator*()
+        {
+            return *m_draft;
+        }
+
+    private:
+        Accessor(RcuSharedResource<T, Mutex> *resource) :
+            m_lock(resource->m_mutex),
+            m_shared_resource(resource),
+            m_draft(std::make_unique<T>(*resource->snapshot())) { }
+
+        void publish()
+        {
+            if (m_draft)
+            {
+                m_shared_resource->store(Snapshot(std::move(m_draft)));
+            }
+        }
+
+        std::unique_lock<Mutex>     m_lock;
+        RcuSharedResource           *m_shared_resource;
+        std::unique_ptr<T>          m_draft;
+    };
+
+    // Writers are serialized by Mutex. The copy of the current value is made
+    // under the lock, so no concurrent update is lost.
+    Accessor lock()
+    {
+        return Accessor(this);
+    }
+
+    Snapshot snapshot() const
+    {
+#if defined(__cpp_lib_atomic_shared_ptr)
+        return m_current.load(std::memory_order_acquire);
+#else
+        return std::atomic_load_explicit(&m_current, std::memory_order_acquire);
+#endif
+    }
+
+private:
+    void store(Snapshot snapshot)
+    {
+#if defined(__cpp_lib_atomic_shared_ptr)
+        m_current.store(std::move(snapshot), std::memory_order_release);
+#else
+        std::atomic_store_explicit(&m_current, std::move(snapshot), std::memory_order_release);
+#endif
+    }
+
+#if defined(__cpp_lib_atomic_shared_ptr)
+    std::atomic<Snapshot>   m_current;
+#else
+    Snapshot                m_current;
+#endif
+    Mutex                   m_mutex;
+};
+
+#endif //RCU_SHARED_RESOURCE_H
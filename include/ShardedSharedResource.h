@@ -0,0 +1,107 @@
+#ifndef SHARDED_SHARED_RESOURCE_H
+#define SHARDED_SHARED_RESOURCE_H
+
+#include <array>
+#include <cstdint>
+#include <functional>
+
+#include "SharedResource.h"
+
+// Splits a keyed container into N independently locked shards. Keys are
+// spread over shards by hash, so threads working on different keys rarely
+// contend on the same mutex.
+template<typename Map, std::size_t N, typename Mutex = std::mutex,
+         typename Hash = std::hash<typename Map::key_type>>
+class ShardedSharedResource
+{
+    static_assert(N > 0, "ShardedSharedResource needs at least one shard");
+
+    struct alignas(shared_resource_detail::cacheLineSize) Shard
+    {
+        template<typename ...Args>
+        Shard(Args&& ...args) : m_resource(std::forward<Args>(args)...) { }
+
+        SharedResource<Map, Mutex> m_resource;
+    };
+
+public:
+    using Key = typename Map::key_type;
+    using Accessor = typename SharedResource<Map, Mutex>::Accessor;
+    using ConstAccessor = typename SharedResource<Map, Mutex>::ConstAccessor;
+
+    // Every shard is constructed from the same arguments.
+    template<typename ...Args>
+    ShardedSharedResource(const Args& ...args) :
+        ShardedSharedResource(std::make_index_sequence<N>(), args...) { }
+
+    ~ShardedSharedResource() = default;
+    ShardedSharedResource(ShardedSharedResource&&) = delete;
+    ShardedSharedResource(const ShardedSharedResource&) = delete;
+    ShardedSharedResource& operator=(ShardedSharedResource&&) = delete;
+    ShardedSharedResource& operator=(const ShardedSharedResource&) = delete;
+
+    static constexpr std::size_t shardCount() noexcept
+    {
+        return N;
+    }
+
+    std::size_t shardIndex(const Key& key) const
+    {
+        // Fibonacci hashing: the shard index comes from the high bits, so keys
+        // within one shard still spread over the map's own buckets.
+        const std::uint64_t mixed = static_cast<std::uint64_t>(m_hash(key)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<std::size_t>((mixed >> 32) % N);
+    }
+
+    Accessor lock(const Key& key)
+    {
+        return lockShard(shardIndex(key));
+    }
+
+    ConstAccessor lockConst(const Key& key) const
+    {
+        return lockConstShard(shardIndex(key));
+    }
+
+    Accessor lockShard(std::size_t index)
+    {
+        return m_shards[index].m_resource.lock();
+    }
+
+    ConstAccessor lockConstShard(std::size_t index) const
+    {
+        return m_shards[index].m_resource.lockConst();
+    }
+
+    // Visits every shard in turn, holding only that shard's lock. The walk is
+    // not a snapshot: shards already visited may change before it finishes.
+    template<typename Func>
+    void forEachShard(Func&& func)
+    {
+        for (auto& shard : m_shards)
+        {
+            auto accessor = shard.m_resource.lock();
+            func(*accessor);
+        }
+    }
+
+    template<typename Func>
+    void forEachShard(Func&& func) const
+    {
+        for (auto& shard : m_shards)
+        {
+            auto accessor = shard.m_resource.lockConst();
+            func(*accessor);
+        }
+    }
+
+private:
+    template<std::size_t ...I, typename ...Args>
+    ShardedSharedResource(std::index_sequence<I...>, const Args& ...args) :
+        m_shards{{ (static_cast<void>(I), Shard(args...))... }} { }
+
+    std::array<Shard, N>    m_shards;
+    Hash                    m_hash;
+};
+
+#endif //SHARDED_SHARED_RESOURCE_H
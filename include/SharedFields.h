@@ -0,0 +1,93 @@
+#ifndef SHARED_FIELDS_H
+#define SHARED_FIELDS_H
+
+#include <cstddef>
+#include <mutex>
+#include <tuple>
+#include <utility>
+
+#include "SharedResource.h"
+
+// Composite of independently locked fields. Every field is a SharedResource
+// of its own on a separate cache line, so threads working on unrelated
+// fields neither contend on a mutex nor share a line. Fields are addressed
+// by index; lockFields() locks several of them without risking deadlock.
+template<typename Mutex, typename ...Fields>
+class BasicSharedFields
+{
+    static_assert(sizeof...(Fields) > 0, "SharedFields needs at least one field");
+
+    template<typename Field>
+    struct alignas(shared_resource_detail::cacheLineSize) Slot
+    {
+        Slot() = default;
+
+        template<typename Arg>
+        Slot(Arg&& arg) : m_resource(std::forward<Arg>(arg)) { }
+
+        SharedResource<Field, Mutex> m_resource;
+    };
+
+public:
+    template<std::size_t I>
+    using Field = typename std::tuple_element<I, std::tuple<Fields...>>::type;
+
+    template<std::size_t I>
+    using Resource = SharedResource<Field<I>, Mutex>;
+
+    BasicSharedFields() = default;
+
+    // Takes one initial value per field.
+    template<typename ...Args, typename = typename std::enable_if<sizeof...(Args) == sizeof...(Fields)>::type>
+    explicit BasicSharedFields(Args&& ...args) : m_slots(std::forward<Args>(args)...) { }
+
+    ~BasicSharedFields() = default;
+    BasicSharedFields(BasicSharedFields&&) = delete;
+    BasicSharedFields(const BasicSharedFields&) = delete;
+    BasicSharedFields& operator=(BasicSharedFields&&) = delete;
+    BasicSharedFields& operator=(const BasicSharedFields&) = delete;
+
+    static constexpr std::size_t fieldCount() noexcept
+    {
+        return sizeof...(Fields);
+    }
+
+    template<std::size_t I>
+    Resource<I>& field() noexcept
+    {
+        return std::get<I>(m_slots).m_resource;
+    }
+
+    template<std::size_t I>
+    const Resource<I>& field() const noexcept
+    {
+        return std::get<I>(m_slots).m_resource;
+    }
+
+    template<std::size_t I>
+    typename Resource<I>::Accessor lock()
+    {
+        return field<I>().lock();
+    }
+
+    template<std::size_t I>
+    typename Resource<I>::ConstAccessor lockConst() const
+    {
+        return field<I>().lockConst();
+    }
+
+    // Locks the given fields together, see lockAll().
+    template<std::size_t ...I>
+    auto lockFields()
+    {
+        return lockAll(field<I>()...);
+    }
+
+private:
+    std::tuple<Slot<Fields>...> m_slots;
+};
+
+template<typename ...Fields>
+using SharedFields = BasicSharedFields<std::mutex, Fields...>;
+
+#endif //SHARED_FIELDS_H
@@ -0,0 +1,259 @@
+#ifndef SHARED_QUEUE_H
+#define SHARED_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "SharedResource.h"
+
+// Producer/consumer channel with separate producer and consumer locks.
+// Producers append to an input deque; a consumer pops from an output deque
+// and, once that runs dry, swaps in everything the producers queued in a
+// single step. Producers and consumers therefore only meet at that swap.
+//
+// Elements are only ever moved, so move-only types work. pushN() and popN()
+// move whole batches per lock acquisition, and condition variables are only
+// signalled when the queue goes from empty to non-empty or from full to
+// non-full, and only if somebody is actually waiting.
+//
+// A queue can be closed: pushes then fail, and pops drain what is left and
+// then return nothing instead of blocking.
+template<typename T, typename Mutex = std::mutex>
+class SharedQueue
+{
+    using Cv = typename std::conditional<std::is_same<Mutex, std::mutex>::value,
+                                         std::condition_variable,
+                                         std::condition_variable_any>::type;
+
+    struct Input
+    {
+        std::deque<T>   m_items;
+        bool            m_closed = false;
+        bool            m_consumer_waiting = false;
+        std::size_t     m_producers_waiting = 0;
+    };
+
+public:
+    static constexpr std::size_t unbounded = 0;
+
+    explicit SharedQueue(std::size_t capacity = unbounded) : m_capacity(capacity) { }
+
+    ~SharedQueue() = default;
+    SharedQueue(SharedQueue&&) = delete;
+    SharedQueue(const SharedQueue&) = delete;
+    SharedQueue& operator=(SharedQueue&&) = delete;
+    SharedQueue& operator=(const SharedQueue&) = delete;
+
+    std::size_t capacity() const noexcept
+    {
+        return m_capacity;
+    }
+
+    // Number of queued items; only a hint while other threads are active.
+    std::size_t size() const noexcept
+    {
+        return m_size.load(std::memory_order_relaxed);
+    }
+
+    // Returns false if the queue is closed.
+    bool push(T value)
+    {
+        return pushN(std::make_move_iterator(&value), std::make_move_iterator(&value + 1)) == 1;
+    }
+
+    // Does not wait for room. value is left untouched on failure.
+    bool tryPush(T&& value)
+    {
+        auto input = m_in.lock();
+        if (input->m_closed || room() == 0)
+        {
+            return false;
+        }
+
+        auto first = std::make_move_iterator(&value);
+        appendSome(input, first, first + 1);
+        return true;
+    }
+
+    // Queues [first, last), waiting for room in a bounded queue. Elements are
+    // constructed from *first, so pass move iterators to move them. Returns
+    // how many were queued, which is less than all only if the queue got
+    // closed meanwhile.
+    template<typename InputIt>
+    std::size_t pushN(InputIt first, InputIt last)
+    {
+        std::size_t pushed = 0;
+        auto input = m_in.lock();
+        while (first != last && !input->m_closed)
+        {
+            if (room() == 0)
+            {
+                ++input->m_producers_waiting;
+                input.wait(m_not_full, [this, &input] { return input->m_closed || room() != 0; });
+                --input->m_producers_waiting;
+                continue;
+            }
+
+            pushed += appendSome(input, first, last);
+        }
+        return pushed;
+    }
+
+    // Waits for an item. Returns nothing once the queue is closed and drained.
+    std::optional<T> pop()
+    {
+        std::optional<T> value;
+        popSome(1, true, [&value](T&& item) { value.emplace(std::move(item)); });
+        return value;
+    }
+
+    std::optional<T> tryPop()
+    {
+        std::optional<T> value;
+        popSome(1, false, [&value](T&& item) { value.emplace(std::move(item)); });
+        return value;
+    }
+
+    // Waits for at least one item, then moves up to max_count items to out.
+    // Returns 0 only once the queue is closed and drained, or right away if
+    // max_count is 0.
+    template<typename OutputIt>
+    std::size_t popN(OutputIt out, std::size_t max_count)
+    {
+        return popSome(max_count, true, [&out](T&& item) { *out++ = std::move(item); });
+    }
+
+    template<typename OutputIt>
+    std::size_t tryPopN(OutputIt out, std::size_t max_count)
+    {
+        return popSome(max_count, false, [&out](T&& item) { *out++ = std::move(item); });
+    }
+
+    void close()
+    {
+        {
+            auto input = m_in.lock();
+            input->m_closed = true;
+        }
+        m_not_empty.notify_all();
+        m_not_full.notify_all();
+    }
+
+    bool isClosed() const
+    {
+        return m_in.lockConst()->m_closed;
+    }
+
+private:
+    using InputAccessor = typename SharedResource<Input, Mutex>::Accessor;
+
+    std::size_t room() const noexcept
+    {
+        if (m_capacity == unbounded)
+        {
+            return std::numeric_limits<std::size_t>::max();
+        }
+        return m_capacity - m_size.load(std::memory_order_relaxed);
+    }
+
+    template<typename InputIt>
+    std::size_t appendSome(InputAccessor& input, InputIt& first, InputIt last)
+    {
+        const auto was_empty = input->m_items.empty();
+        auto left = room();
+        std::size_t count = 0;
+        for (; first != last && left != 0; ++first, --left, ++count)
+        {
+            input->m_items.emplace_back(*first);
+        }
+        published(input, was_empty, count);
+        return count;
+    }
+
+    // Only a consumer that found both sides empty waits, and it does so while
+    // holding the consumer lock, so there is at most one to wake.
+    void published(InputAccessor& input, bool was_empty, std::size_t count)
+    {
+        m_size.fetch_add(count, std::memory_order_relaxed);
+        if (was_empty && count != 0 && input->m_consumer_waiting)
+        {
+            m_not_empty.notify_one();
+        }
+    }
+
+    template<typename Sink>
+    std::size_t popSome(std::size_t max_count, bool wait, Sink sink)
+    {
+        if (max_count == 0)
+        {
+            return 0;
+        }
+
+        auto output = m_out.lock();
+        if (output->empty() && !refill(*output, wait))
+        {
+            return 0;
+        }
+
+        // Tops up from the producer side without waiting once the first
+        // batch is used up.
+        std::size_t count = 0;
+        while (count < max_count && (!output->empty() || refill(*output, false)))
+        {
+            sink(std::move(output->front()));
+            output->pop_front();
+            ++count;
+        }
+        consumed(count);
+        return count;
+    }
+
+    // Called with the consumer lock held and the output side empty. Swapping
+    // keeps the allocated blocks of both deques in use.
+    bool refill(std::deque<T>& output, bool wait)
+    {
+        auto input = m_in.lock();
+        if (wait && input->m_items.empty() && !input->m_closed)
+        {
+            input->m_consumer_waiting = true;
+            input.wait(m_not_empty, [&input] { return input->m_closed || !input->m_items.empty(); });
+            input->m_consumer_waiting = false;
+        }
+
+        output.swap(input->m_items);
+        return !output.empty();
+    }
+
+    // Producers check for room under the producer lock, so taking it before
+    // signalling means none of them can miss the wakeup.
+    void consumed(std::size_t count)
+    {
+        const auto before = m_size.fetch_sub(count, std::memory_order_relaxed);
+        if (m_capacity == unbounded || before < m_capacity || count == 0)
+        {
+            return;
+        }
+
+        if (m_in.lockConst()->m_producers_waiting != 0)
+        {
+            m_not_full.notify_all();
+        }
+    }
+
+    alignas(shared_resource_detail::cacheLineSize) SharedResource<Input, Mutex> m_in;
+    alignas(shared_resource_detail::cacheLineSize) SharedResource<std::deque<T>, Mutex> m_out;
+    alignas(shared_resource_detail::cacheLineSize) std::atomic<std::size_t> m_size{0};
+    Cv                                                                      m_not_empty;
+    Cv                                                                      m_not_full;
+    const std::size_t                                                       m_capacity;
+};
+
+#endif //SHARED_QUEUE_H
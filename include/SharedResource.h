@@ -2,206 +2,2848 @@
 #define SHARED_RESOURCE_H
 
 #include <mutex>
+#include <shared_mutex>
 #include <condition_variable>
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <new>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
-template<typename T, typename Mutex = std::mutex>
-class SharedResource
+#if __has_include(<version>)
+#include <version>
+#endif
+
+#if defined(__cpp_lib_jthread)
+#include <stop_token>
+#endif
+
+#if defined(__cpp_impl_coroutine) && defined(__cpp_lib_coroutine)
+#define SHARED_RESOURCE_HAS_COROUTINES
+#include <coroutine>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/membarrier.h>)
+#define SHARED_RESOURCE_HAS_MEMBARRIER
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace shared_resource_detail
 {
-    class AccessorBase
+    struct LockAccess;
+
+    constexpr std::size_t cacheLineSize = 64;
+
+    template<typename Mutex, typename = void>
+    struct IsSharedMutex : std::false_type { };
+
+    template<typename Mutex>
+    struct IsSharedMutex<Mutex, std::void_t<decltype(std::declval<Mutex&>().lock_shared()),
+                                            decltype(std::declval<Mutex&>().unlock_shared())>> : std::true_type { };
+
+    template<typename Mutex, typename = void>
+    struct IsUpgradeMutex : std::false_type { };
+
+    template<typename Mutex>
+    struct IsUpgradeMutex<Mutex, std::void_t<decltype(std::declval<Mutex&>().lock_upgrade()),
+                                             decltype(std::declval<Mutex&>().unlock_upgrade()),
+                                             decltype(std::declval<Mutex&>().unlock_upgrade_and_lock())>> : std::true_type { };
+
+    template<typename Mutex, typename = void>
+    struct CanDowngrade : std::false_type { };
+
+    template<typename Mutex>
+    struct CanDowngrade<Mutex, std::void_t<decltype(std::declval<Mutex&>().unlock_and_lock_shared())>> : std::true_type { };
+
+    // Lock used by ConstAccessor over a shared mutex. Normally holds the mutex
+    // in shared mode, but can also adopt an exclusive lock taken by Accessor.
+    template<typename Mutex>
+    class ReadLock
     {
     public:
-        template<typename Cv, typename ...Args>
-        void wait(Cv& cv, Args&& ...args)
+        ReadLock() noexcept = default;
+
+        explicit ReadLock(Mutex& mutex) : m_mutex(&mutex)
         {
-            cv.wait(m_lock, std::forward<Args>(args)...);
+            lock();
         }
 
-        template<typename Cv, typename Rep, typename Period>
-        std::cv_status waitFor(Cv& cv, const std::chrono::duration<Rep,Period>& rel_time)
+        ReadLock(Mutex& mutex, std::defer_lock_t) noexcept : m_mutex(&mutex) { }
+
+        explicit ReadLock(std::unique_lock<Mutex>&& lock) noexcept :
+            m_mutex(lock.mutex()),
+            m_owns(lock.owns_lock()),
+            m_exclusive(true)
         {
-            return cv.wait_for(m_lock, rel_time);
+            lock.release();
         }
 
-        template<typename Cv, typename Rep, typename Period, typename Predicate>
-        bool waitFor(Cv& cv, const std::chrono::duration<Rep,Period>& rel_time, Predicate pred)
+        ~ReadLock()
         {
-            return cv.wait_for(m_lock, rel_time, pred);
+            if (m_owns)
+            {
+                unlock();
+            }
         }
 
-        template<typename Cv, typename Clock, typename Duration>
-        std::cv_status waitUntil(Cv& cv, const std::chrono::time_point<Clock,Duration>& abs_time)
+        ReadLock(const ReadLock&) = delete;
+        ReadLock& operator=(const ReadLock&) = delete;
+
+        ReadLock(ReadLock&& l) noexcept :
+            m_mutex(l.m_mutex),
+            m_owns(l.m_owns),
+            m_exclusive(l.m_exclusive)
         {
-            return cv.wait_until(m_lock, abs_time);
+            l.m_mutex = nullptr;
+            l.m_owns = false;
         }
 
-        template<typename Cv, typename Clock, typename Duration, typename Predicate>
-        bool waitUntil(Cv& cv, const std::chrono::time_point<Clock,Duration>& abs_time, Predicate pred)
+        ReadLock& operator=(ReadLock&& l) noexcept
         {
-            return cv.wait_until(m_lock, abs_time, pred);
+            if (&l != this)
+            {
+                if (m_owns)
+                {
+                    unlock();
+                }
+                m_mutex = l.m_mutex;
+                m_owns = l.m_owns;
+                m_exclusive = l.m_exclusive;
+                l.m_mutex = nullptr;
+                l.m_owns = false;
+            }
+            return *this;
         }
 
-    protected:
-        AccessorBase(const SharedResource<T, Mutex> *resource) : m_lock(resource->m_mutex) { }
-        ~AccessorBase() = default;
+        void lock()
+        {
+            if (m_exclusive)
+            {
+                m_mutex->lock();
+            }
+            else
+            {
+                m_mutex->lock_shared();
+            }
+            m_owns = true;
+        }
 
-        AccessorBase(AccessorBase&& a) : m_lock(std::move(a.m_lock)) { }
+        bool try_lock()
+        {
+            m_owns = m_exclusive ? m_mutex->try_lock() : m_mutex->try_lock_shared();
+            return m_owns;
+        }
 
-        AccessorBase& operator=(AccessorBase&& a)
+        template<typename Rep, typename Period>
+        bool try_lock_for(const std::chrono::duration<Rep,Period>& rel_time)
         {
-            if (&a != this)
+            m_owns = m_exclusive ? m_mutex->try_lock_for(rel_time) : m_mutex->try_lock_shared_for(rel_time);
+            return m_owns;
+        }
+
+        template<typename Clock, typename Duration>
+        bool try_lock_until(const std::chrono::time_point<Clock,Duration>& abs_time)
+        {
+            m_owns = m_exclusive ? m_mutex->try_lock_until(abs_time) : m_mutex->try_lock_shared_until(abs_time);
+            return m_owns;
+        }
+
+        void unlock()
+        {
+            if (m_exclusive)
             {
-                m_lock = std::move(a.m_lock);
+                m_mutex->unlock();
             }
-            return *this;
+            else
+            {
+                m_mutex->unlock_shared();
+            }
+            m_owns = false;
         }
 
-    private:
-        std::unique_lock<Mutex> m_lock;
-    };
+        bool owns_lock() const noexcept
+        {
+            return m_owns;
+        }
 
-public:
-    template<typename ...Args>
-    SharedResource(Args&& ...args) : m_resource(std::forward<Args>(args)...) { }
+        Mutex* mutex() const noexcept
+        {
+            return m_mutex;
+        }
 
-    ~SharedResource() = default;
-    SharedResource(SharedResource&&) = delete;
-    SharedResource(const SharedResource&) = delete;
-    SharedResource& operator=(SharedResource&&) = delete;
-    SharedResource& operator=(const SharedResource&) = delete;
+        // Turns an adopted exclusive lock into a shared one without
+        // unlocking in between.
+        void downgrade()
+        {
+            if (m_owns && m_exclusive)
+            {
+                m_mutex->unlock_and_lock_shared();
+            }
+            m_exclusive = false;
+        }
 
-    class Accessor : public AccessorBase
+    private:
+        Mutex   *m_mutex = nullptr;
+        bool    m_owns = false;
+        bool    m_exclusive = false;
+    };
+
+    // Holds a mutex in upgrade mode, see UpgradeMutex.
+    template<typename Mutex>
+    class UpgradeLock
     {
-        friend class SharedResource<T, Mutex>;
     public:
-        ~Accessor() = default;
+        UpgradeLock(Mutex& mutex, std::defer_lock_t) noexcept : m_mutex(&mutex) { }
 
-        Accessor(const Accessor&) = delete;
-        Accessor& operator=(const Accessor&) = delete;
+        ~UpgradeLock()
+        {
+            if (m_owns)
+            {
+                unlock();
+            }
+        }
 
-        Accessor(Accessor&& a) :
-            AccessorBase(std::move(a)),
-            m_shared_resource(a.m_shared_resource)
+        UpgradeLock(const UpgradeLock&) = delete;
+        UpgradeLock& operator=(const UpgradeLock&) = delete;
+
+        UpgradeLock(UpgradeLock&& l) noexcept :
+            m_mutex(l.m_mutex),
+            m_owns(l.m_owns)
         {
-            a.m_shared_resource = nullptr;
+            l.m_mutex = nullptr;
+            l.m_owns = false;
         }
 
-        Accessor& operator=(Accessor&& a)
+        UpgradeLock& operator=(UpgradeLock&& l) noexcept
         {
-            if (&a != this)
+            if (&l != this)
             {
-                AccessorBase::operator=(std::move(a));
-                m_shared_resource = a.m_shared_resource;
-                a.m_shared_resource = nullptr;
+                if (m_owns)
+                {
+                    unlock();
+                }
+                m_mutex = l.m_mutex;
+                m_owns = l.m_owns;
+                l.m_mutex = nullptr;
+                l.m_owns = false;
             }
             return *this;
         }
 
-        bool isValid() const noexcept
+        void lock()
         {
-            return m_shared_resource != nullptr;
+            m_mutex->lock_upgrade();
+            m_owns = true;
         }
 
-        T* operator->()
+        bool try_lock()
         {
-            return m_shared_resource;
+            m_owns = m_mutex->try_lock_upgrade();
+            return m_owns;
         }
 
-        T& operator*()
+        void unlock()
         {
-            return *m_shared_resource;
+            m_mutex->unlock_upgrade();
+            m_owns = false;
+        }
+
+        bool owns_lock() const noexcept
+        {
+            return m_owns;
+        }
+
+        // Atomically trades upgrade ownership for exclusive ownership and
+        // hands the mutex over to a unique_lock.
+        std::unique_lock<Mutex> upgrade()
+        {
+            if (!m_owns)
+            {
+                return std::unique_lock<Mutex>();
+            }
+
+            m_mutex->unlock_upgrade_and_lock();
+            m_owns = false;
+            return std::unique_lock<Mutex>(*m_mutex, std::adopt_lock);
         }
 
     private:
-        Accessor(SharedResource<T, Mutex> *resource) :
-            AccessorBase(resource),
-            m_shared_resource(&resource->m_resource) { }
+        Mutex   *m_mutex = nullptr;
+        bool    m_owns = false;
+    };
 
-        T   *m_shared_resource;
+    inline void cpuRelax() noexcept
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        asm volatile("yield");
+#endif
+    }
+
+    // Test-and-set flag for the short critical sections of per-thread slots.
+    struct SpinFlag
+    {
+        void acquire() noexcept
+        {
+            while (m_busy.exchange(true, std::memory_order_acquire))
+            {
+                cpuRelax();
+            }
+        }
+
+        void release() noexcept
+        {
+            m_busy.store(false, std::memory_order_release);
+        }
+
+        std::atomic<bool> m_busy{false};
+    };
+
+    // Returns the object behind pointer, creating it on first use. A thread
+    // that loses the race deletes its copy and takes the winner's.
+    template<typename U>
+    U& lazyCreate(std::atomic<U*>& pointer)
+    {
+        auto current = pointer.load(std::memory_order_acquire);
+        if (!current)
+        {
+            auto created = new U();
+            if (pointer.compare_exchange_strong(current, created, std::memory_order_acq_rel,
+                                                std::memory_order_acquire))
+            {
+                current = created;
+            }
+            else
+            {
+                delete created;
+            }
+        }
+        return *current;
+    }
+
+    // Whether process-wide barriers are available. If so, releases get away
+    // with a compiler barrier until a resource is primed, see
+    // SharedResource::prime(). Decided once, before any resource exists.
+    inline bool asymmetricFences() noexcept
+    {
+#if defined(SHARED_RESOURCE_HAS_MEMBARRIER)
+        static const bool registered =
+            ::syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+        return registered;
+#else
+        return false;
+#endif
+    }
+
+    // Heavy side of an asymmetric fence: once it returns, every other thread
+    // of the process has passed a full barrier.
+    inline void processBarrier() noexcept
+    {
+#if defined(SHARED_RESOURCE_HAS_MEMBARRIER)
+        if (asymmetricFences())
+        {
+            ::syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+        }
+#endif
+    }
+
+    // Threads blocked on the mutex of a SharedResource. m_left counts those
+    // that have since got the lock or given up.
+    struct LockWaiters
+    {
+        std::atomic<std::uint32_t> m_blocked{0};
+        std::atomic<std::uint32_t> m_left{0};
+    };
+
+    class WaiterCount
+    {
+    public:
+        explicit WaiterCount(LockWaiters& waiters) noexcept : m_waiters(waiters)
+        {
+            m_waiters.m_blocked.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        ~WaiterCount()
+        {
+            m_waiters.m_left.fetch_add(1, std::memory_order_release);
+            m_waiters.m_blocked.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        WaiterCount(const WaiterCount&) = delete;
+        WaiterCount& operator=(const WaiterCount&) = delete;
+
+    private:
+        LockWaiters &m_waiters;
+    };
+
+    template<typename>
+    using WaiterCountOf = WaiterCount;
+
+    template<typename T>
+    struct UseSequenceLock : std::integral_constant<bool, std::is_trivially_copyable<T>::value &&
+                                                          sizeof(T) <= 4 * cacheLineSize> { };
+
+    // Sequence counter of a seqlock: odd while a writer holds an Accessor.
+    // Readers copy the value optimistically and retry if the counter moved.
+    template<bool Enabled>
+    class Sequence
+    {
+    protected:
+        void beginWrite() noexcept { }
+        void endWrite() noexcept { }
+    };
+
+    template<>
+    class Sequence<true>
+    {
+    protected:
+        void beginWrite() noexcept
+        {
+            m_sequence.store(m_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        void endWrite() noexcept
+        {
+            m_sequence.store(m_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        // Gives up after a short spin, e.g. while a writer holds an Accessor,
+        // and returns fallback() instead.
+        template<typename T, typename Fallback>
+        T read(const T& value, Fallback&& fallback) const
+        {
+            alignas(T) unsigned char buffer[sizeof(T)];
+            for (unsigned spin = 0; spin < readSpins; ++spin)
+            {
+                const unsigned before = m_sequence.load(std::memory_order_acquire);
+                if (before & 1u)
+                {
+                    cpuRelax();
+                    continue;
+                }
+
+                std::memcpy(buffer, static_cast<const void*>(std::addressof(value)), sizeof(T));
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                if (m_sequence.load(std::memory_order_relaxed) == before)
+                {
+                    return *std::launder(reinterpret_cast<const T*>(buffer));
+                }
+            }
+            return fallback();
+        }
+
+    private:
+        static constexpr unsigned readSpins = 64;
+
+        std::atomic<unsigned> m_sequence{0};
     };
 
+    // Spreads threads over the combining slots; assigned once per thread.
+    inline std::size_t threadSlotHint() noexcept
+    {
+        static std::atomic<std::size_t> next{0};
+        thread_local const std::size_t hint = next.fetch_add(1, std::memory_order_relaxed);
+        return hint;
+    }
 
-    class ConstAccessor : public AccessorBase
+    // Publication list for flat combining. A pending apply() parks a request
+    // in a slot, and whichever thread gets the lock runs every parked request
+    // in one pass, keeping the resource hot in a single core's cache.
+    template<typename T>
+    class Combiner
     {
-        friend class SharedResource<T, Mutex>;
     public:
-        ~ConstAccessor() = default;
+        struct Request
+        {
+            void                (*m_run)(Request *request, T& value) noexcept;
+            std::atomic<bool>   m_done{false};
+        };
 
-        ConstAccessor(const ConstAccessor&) = delete;
-        ConstAccessor& operator=(const ConstAccessor&) = delete;
+        bool publish(Request *request) noexcept
+        {
+            const std::size_t hint = threadSlotHint();
+            for (std::size_t i = 0; i < slotCount; ++i)
+            {
+                auto& slot = m_slots[(hint + i) % slotCount].m_request;
+                Request *expected = nullptr;
+                if (slot.load(std::memory_order_relaxed) == nullptr &&
+                    slot.compare_exchange_strong(expected, request, std::memory_order_release,
+                                                 std::memory_order_relaxed))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
 
-        ConstAccessor(ConstAccessor&& a) :
-            AccessorBase(std::move(a)),
-            m_shared_resource(a.m_shared_resource)
+        // Takes a request back unless a combiner has already claimed it.
+        bool retract(Request *request) noexcept
         {
-            a.m_shared_resource = nullptr;
+            for (auto& slot : m_slots)
+            {
+                Request *expected = request;
+                if (slot.m_request.load(std::memory_order_relaxed) == request &&
+                    slot.m_request.compare_exchange_strong(expected, nullptr, std::memory_order_relaxed))
+                {
+                    return true;
+                }
+            }
+            return false;
         }
 
-        ConstAccessor(Accessor&& a) :
-            AccessorBase(std::move(a)),
-            m_shared_resource(a.m_shared_resource)
+        // Each request is claimed by clearing its slot before it runs, so a
+        // retracted request is never run as well.
+        void combine(T& value) noexcept
         {
-            a.m_shared_resource = nullptr;
+            for (auto& slot : m_slots)
+            {
+                if (slot.m_request.load(std::memory_order_relaxed) == nullptr)
+                {
+                    continue;
+                }
+
+                Request *request = slot.m_request.exchange(nullptr, std::memory_order_acquire);
+                if (request)
+                {
+                    request->m_run(request, value);
+                    request->m_done.store(true, std::memory_order_release);
+                }
+            }
         }
 
-        ConstAccessor& operator=(ConstAccessor&& a)
+    private:
+        static constexpr std::size_t slotCount = 64;
+
+        struct alignas(cacheLineSize) Slot
         {
-            if (&a != this)
+            std::atomic<Request*> m_request{nullptr};
+        };
+
+        std::array<Slot, slotCount> m_slots;
+    };
+
+    template<typename T, typename Func, typename Result>
+    struct CombinedCall : Combiner<T>::Request
+    {
+        CombinedCall(Func& func) : m_func(func)
+        {
+            this->m_run = &run;
+        }
+
+        static void run(typename Combiner<T>::Request *request, T& value) noexcept
+        {
+            auto call = static_cast<CombinedCall*>(request);
+            try
             {
-                AccessorBase::operator=(std::move(a));
-                m_shared_resource = a.m_shared_resource;
-                a.m_shared_resource = nullptr;
+                if constexpr (std::is_void<Result>::value)
+                {
+                    std::invoke(call->m_func, value);
+                }
+                else
+                {
+                    call->m_result.emplace(std::invoke(call->m_func, value));
+                }
+            }
+            catch (...)
+            {
+                call->m_exception = std::current_exception();
             }
-            return *this;
         }
 
-        ConstAccessor& operator=(Accessor&& a)
+        Result result()
         {
-            if (&a != this)
+            if (m_exception)
             {
-                AccessorBase::operator=(std::move(a));
-                m_shared_resource = a.m_shared_resource;
-                a.m_shared_resource = nullptr;
+                std::rethrow_exception(m_exception);
+            }
+
+            if constexpr (!std::is_void<Result>::value)
+            {
+                return std::move(*m_result);
             }
-            return *this;
         }
 
-        bool isValid() const noexcept
+        Func                                                                    &m_func;
+        std::optional<typename std::conditional<std::is_void<Result>::value,
+                                                bool, Result>::type>            m_result;
+        std::exception_ptr                                                      m_exception;
+    };
+
+    // Write-behind buffer of defer(). Each thread appends to its own stripe,
+    // guarded by a flag that only sees contention when more threads than
+    // stripes defer at once. Stripes are drained in one batch by whoever
+    // next takes the resource exclusively.
+    template<typename T>
+    class DeferBuffer
+    {
+    public:
+        using Operation = std::function<void(T&)>;
+
+        static constexpr std::size_t drainThreshold = 64;
+
+        // Returns true once the caller's stripe holds drainThreshold operations.
+        bool push(Operation operation)
         {
-            return m_shared_resource != nullptr;
+            auto& stripe = m_stripes[threadSlotHint() % stripeCount];
+            stripe.acquire();
+            stripe.m_operations.push_back(std::move(operation));
+            const auto size = stripe.m_operations.size();
+            stripe.release();
+
+            m_pending.fetch_add(1, std::memory_order_release);
+            return size >= drainThreshold;
         }
 
-        const T* operator->() const
+        bool empty() const noexcept
         {
-            return m_shared_resource;
+            return m_pending.load(std::memory_order_acquire) == 0;
         }
 
-        const T& operator*() const
+        // Number of drains that merged at least one operation.
+        std::uint64_t drains() const noexcept
         {
-            return *m_shared_resource;
+            return m_drains.load(std::memory_order_acquire);
+        }
+
+        // Called with the resource locked exclusively.
+        void drain(T& value)
+        {
+            bool merged = false;
+            std::vector<Operation> batch;
+            for (auto& stripe : m_stripes)
+            {
+                stripe.acquire();
+                batch.swap(stripe.m_operations);
+                stripe.release();
+
+                if (!merged && !batch.empty())
+                {
+                    m_drains.fetch_add(1, std::memory_order_release);
+                    merged = true;
+                }
+                for (auto& operation : batch)
+                {
+                    operation(value);
+                }
+                m_pending.fetch_sub(batch.size(), std::memory_order_relaxed);
+                batch.clear();
+            }
         }
 
     private:
-        ConstAccessor(const SharedResource<T, Mutex> *resource) :
-            AccessorBase(resource),
-            m_shared_resource(&resource->m_resource) { }
+        static constexpr std::size_t stripeCount = 16;
 
-        const T *m_shared_resource;
+        struct alignas(cacheLineSize) Stripe : SpinFlag
+        {
+            std::vector<Operation>  m_operations;
+        };
+
+        std::array<Stripe, stripeCount> m_stripes;
+        std::atomic<std::size_t>        m_pending{0};
+        std::atomic<std::uint64_t>      m_drains{0};
     };
 
-    Accessor lock()
+    // Task queue of post(). Producers push onto an intrusive stack with a
+    // single CAS; the drainer takes the whole stack at once and reverses it,
+    // so tasks still run in the order they were posted.
+    template<typename T>
+    class Strand
     {
-        return Accessor(this);
-    }
+    public:
+        using Executor = std::function<void(std::function<void()>)>;
 
+        // Batches one drain without an executor runs at most.
+        static constexpr unsigned drainBatches = 4;
 
-    ConstAccessor lockConst() const
-    {
-        return ConstAccessor(this);
-    }
+        struct Task
+        {
+            void        (*m_run)(Task *task, T *value) noexcept;
+            Task        *m_next = nullptr;
+        };
 
-private:
-    T               m_resource;
-    mutable Mutex   m_mutex;
-};
+        // Runs func and deletes itself; a null value only deletes.
+        template<typename Func>
+        struct Call : Task
+        {
+            explicit Call(Func&& func) : m_func(std::move(func))
+            {
+                this->m_run = &Call::run;
+            }
+
+            static void run(Task *task, T *value) noexcept
+            {
+                auto call = static_cast<Call*>(task);
+                if (value)
+                {
+                    std::invoke(call->m_func, *value);
+                }
+                delete call;
+            }
+
+            Func m_func;
+        };
+
+        ~Strand()
+        {
+            runAll(nullptr);
+        }
+
+        void push(Task *task) noexcept
+        {
+            task->m_next = m_head.load(std::memory_order_relaxed);
+            while (!m_head.compare_exchange_weak(task->m_next, task, std::memory_order_seq_cst,
+                                                 std::memory_order_relaxed)) { }
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+
+        bool empty() const noexcept
+        {
+            return m_head.load(std::memory_order_seq_cst) == nullptr;
+        }
+
+        // Called with the resource locked exclusively.
+        void runAll(T *value) noexcept
+        {
+            Task *reversed = nullptr;
+            for (auto task = m_head.exchange(nullptr, std::memory_order_acquire); task; )
+            {
+                auto next = std::exchange(task->m_next, reversed);
+                reversed = std::exchange(task, next);
+            }
+
+            while (reversed)
+            {
+                auto task = std::exchange(reversed, reversed->m_next);
+                task->m_run(task, value);
+            }
+        }
+
+        // Returns true if the caller has to schedule a drain.
+        bool schedule() noexcept
+        {
+            return !m_scheduled.exchange(true, std::memory_order_seq_cst);
+        }
+
+        // Returns true if the scheduled drain has to go on.
+        bool finish() noexcept
+        {
+            m_scheduled.store(false, std::memory_order_seq_cst);
+            return !empty() && schedule();
+        }
+
+        Executor m_executor;
+
+    private:
+        std::atomic<Task*>  m_head{nullptr};
+        std::atomic<bool>   m_scheduled{false};
+    };
+
+#if defined(SHARED_RESOURCE_HAS_COROUTINES)
+    struct AsyncWaiter
+    {
+        void        (*m_wake)(AsyncWaiter *waiter) noexcept;
+        bool        m_shared;
+        AsyncWaiter *m_next = nullptr;
+    };
+
+    // FIFO of suspended lockAsync() callers. A waiter enqueues itself and then
+    // retries the lock; a releasing accessor checks the size after unlocking.
+    // Both sides issue a sequentially consistent fence in between, so at
+    // least one of them sees the other and no wakeup is lost.
+    class AsyncQueue
+    {
+    public:
+        bool empty() const noexcept
+        {
+            return m_size.load(std::memory_order_seq_cst) == 0;
+        }
+
+        // Returns false if tryLock() succeeded and the waiter was not queued.
+        // A waiter that was woken but lost the lock again goes to the front.
+        template<typename TryLock>
+        bool enqueue(AsyncWaiter *waiter, TryLock&& tryLock, bool front = false)
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+
+            AsyncWaiter *previous = front ? nullptr : m_tail;
+            AsyncWaiter *&link = previous ? previous->m_next : m_head;
+            waiter->m_next = link;
+            link = waiter;
+            if (!waiter->m_next)
+            {
+                m_tail = waiter;
+            }
+            m_size.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (!tryLock())
+            {
+                return true;
+            }
+
+            link = waiter->m_next;
+            if (m_tail == waiter)
+            {
+                m_tail = previous;
+            }
+            m_size.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        // Dequeues and wakes the first waiter, or the leading run of shared
+        // waiters. Each of them takes the lock itself once it runs.
+        void wakeNext() noexcept
+        {
+            if (empty())
+            {
+                return;
+            }
+
+            AsyncWaiter *woken = nullptr;
+            {
+                std::lock_guard<std::mutex> guard(m_mutex);
+                if (!m_head)
+                {
+                    return;
+                }
+
+                woken = m_head;
+                AsyncWaiter *last = m_head;
+                std::size_t count = 1;
+                while (last->m_shared && last->m_next && last->m_next->m_shared)
+                {
+                    last = last->m_next;
+                    ++count;
+                }
+
+                m_head = last->m_next;
+                if (!m_head)
+                {
+                    m_tail = nullptr;
+                }
+                last->m_next = nullptr;
+                m_size.fetch_sub(count, std::memory_order_relaxed);
+            }
+
+            while (woken)
+            {
+                AsyncWaiter *next = woken->m_next;
+                woken->m_wake(woken);
+                woken = next;
+            }
+        }
+
+    private:
+        std::mutex                  m_mutex;
+        AsyncWaiter                 *m_head = nullptr;
+        AsyncWaiter                 *m_tail = nullptr;
+        std::atomic<std::size_t>    m_size{0};
+    };
+
+    // Coroutine that a woken lockAsync() waiter is scheduled as. It takes the
+    // lock where it runs and then transfers to the awaiting coroutine.
+    struct AsyncRetry
+    {
+        struct FinalTransfer
+        {
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+
+            template<typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+            {
+                return handle.promise().m_continuation;
+            }
+
+            void await_resume() noexcept { }
+        };
+
+        struct promise_type
+        {
+            AsyncRetry get_return_object()
+            {
+                return AsyncRetry{std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            FinalTransfer final_suspend() noexcept { return {}; }
+            void return_void() noexcept { }
+            void unhandled_exception() noexcept { std::terminate(); }
+
+            std::coroutine_handle<> m_continuation;
+        };
+
+        std::coroutine_handle<promise_type> m_handle;
+    };
+
+    // Resumes on the calling thread. A resume issued from within another one
+    // on the same thread, such as a woken waiter releasing its accessor, is
+    // run after it returns, so a long queue does not nest on the stack.
+    struct ResumeInline
+    {
+        void operator()(std::coroutine_handle<> handle) const
+        {
+            thread_local std::vector<std::coroutine_handle<>> *pending = nullptr;
+            if (pending)
+            {
+                pending->push_back(handle);
+                return;
+            }
+
+            std::vector<std::coroutine_handle<>> queue;
+            pending = &queue;
+            handle.resume();
+            for (std::size_t i = 0; i < queue.size(); ++i)
+            {
+                auto next = queue[i];
+                next.resume();
+            }
+            pending = nullptr;
+        }
+    };
+#endif
+
+    // State of the features that most resources never use, allocated on
+    // first use so that the others stay small. The combining slots and the
+    // defer stripes are large enough to get an allocation of their own.
+    template<typename T>
+    struct Extensions
+    {
+        ~Extensions()
+        {
+            delete m_combiner.load(std::memory_order_relaxed);
+            delete m_deferred.load(std::memory_order_relaxed);
+        }
+
+        std::atomic<Combiner<T>*>       m_combiner{nullptr};
+        std::atomic<DeferBuffer<T>*>    m_deferred{nullptr};
+        Strand<T>                       m_strand;
+        LockWaiters                     m_waiters;
+#if defined(SHARED_RESOURCE_HAS_COROUTINES)
+        AsyncQueue                      m_async_queue;
+#endif
+        std::atomic<bool>               m_hooked{false};
+        std::atomic<bool>               m_primed{false};
+    };
+
+#if defined(__cpp_lib_jthread)
+    // Mutexes cannot be interrupted, so a cancellable acquisition polls the
+    // stop token between short timed attempts.
+    template<typename Lock, typename Clock, typename Duration>
+    bool lockUntil(Lock& lock, const std::chrono::time_point<Clock,Duration>& abs_time, const std::stop_token& stop)
+    {
+        const std::chrono::milliseconds poll_interval(1);
+
+        while (!stop.stop_requested())
+        {
+            auto now = Clock::now();
+            if (now >= abs_time)
+            {
+                return lock.try_lock();
+            }
+
+            if (abs_time - now < poll_interval)
+            {
+                return lock.try_lock_until(abs_time);
+            }
+
+            if (lock.try_lock_for(poll_interval))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+#endif
+}
+
+// Default instrumentation policy of SharedResource: records nothing and is
+// compiled out entirely. See LockStats.h for the recording policy.
+struct NoInstrumentation
+{
+    static constexpr bool enabled = false;
+
+    void setName(const char*) const noexcept { }
+    void recordAcquisition(bool, std::chrono::nanoseconds) const noexcept { }
+    void recordHold(std::chrono::nanoseconds) const noexcept { }
+};
+
+namespace shared_resource_detail
+{
+    template<bool Enabled>
+    class HoldTimer
+    {
+    protected:
+        void startHold() noexcept { }
+
+        template<typename Instrumentation>
+        void stopHold(const Instrumentation&) noexcept { }
+    };
+
+    template<>
+    class HoldTimer<true>
+    {
+    protected:
+        void startHold() noexcept
+        {
+            m_start = std::chrono::steady_clock::now();
+        }
+
+        template<typename Instrumentation>
+        void stopHold(const Instrumentation& instrumentation) noexcept
+        {
+            instrumentation.recordHold(std::chrono::steady_clock::now() - m_start);
+        }
+
+    private:
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+    template<typename T>
+    struct IsLockFreeAtomic : std::false_type { };
+
+    template<typename U>
+    struct IsLockFreeAtomic<std::atomic<U>> : std::integral_constant<bool, std::atomic<U>::is_always_lock_free> { };
+
+    // Lock-free operations of SharedResource<std::atomic<U>>. They act on the
+    // stored atomic directly and never touch the mutex or the version counter.
+    template<typename Derived, typename T, bool = IsLockFreeAtomic<T>::value>
+    class AtomicOps { };
+
+    template<typename Derived, typename U>
+    class AtomicOps<Derived, std::atomic<U>, true>
+    {
+    public:
+        void store(U value, std::memory_order order = std::memory_order_seq_cst) noexcept
+        {
+            atomic().store(value, order);
+        }
+
+        U exchange(U value, std::memory_order order = std::memory_order_seq_cst) noexcept
+        {
+            return atomic().exchange(value, order);
+        }
+
+        bool compare_exchange_strong(U& expected, U desired, std::memory_order order = std::memory_order_seq_cst) noexcept
+        {
+            return atomic().compare_exchange_strong(expected, desired, order);
+        }
+
+        template<typename Arg>
+        U fetch_add(Arg arg, std::memory_order order = std::memory_order_seq_cst) noexcept
+        {
+            return atomic().fetch_add(arg, order);
+        }
+
+        template<typename Arg>
+        U fetch_sub(Arg arg, std::memory_order order = std::memory_order_seq_cst) noexcept
+        {
+            return atomic().fetch_sub(arg, order);
+        }
+
+        template<typename Arg>
+        U fetch_and(Arg arg, std::memory_order order = std::memory_order_seq_cst) noexcept
+        {
+            return atomic().fetch_and(arg, order);
+        }
+
+        template<typename Arg>
+        U fetch_or(Arg arg, std::memory_order order = std::memory_order_seq_cst) noexcept
+        {
+            return atomic().fetch_or(arg, order);
+        }
+
+        template<typename Arg>
+        U fetch_xor(Arg arg, std::memory_order order = std::memory_order_seq_cst) noexcept
+        {
+            return atomic().fetch_xor(arg, order);
+        }
+
+        // Replaces the value with func(old) in a CAS loop and returns the new
+        // value. func may run several times under contention, so it should be
+        // free of side effects.
+        template<typename Func>
+        U update(Func func, std::memory_order order = std::memory_order_seq_cst)
+        {
+            auto& value = atomic();
+            U expected = value.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                U desired = std::invoke(func, static_cast<const U&>(expected));
+                if (value.compare_exchange_weak(expected, desired, order, std::memory_order_relaxed))
+                {
+                    return desired;
+                }
+            }
+        }
+
+    private:
+        std::atomic<U>& atomic() noexcept
+        {
+            return static_cast<Derived&>(*this).m_resource;
+        }
+    };
+}
+
+template<typename T, typename Mutex = std::mutex, typename Instrumentation = NoInstrumentation>
+class SharedResource : private shared_resource_detail::Sequence<shared_resource_detail::UseSequenceLock<T>::value>,
+                       private Instrumentation,
+                       public shared_resource_detail::AtomicOps<SharedResource<T, Mutex, Instrumentation>, T>
+{
+    friend struct shared_resource_detail::LockAccess;
+    friend class shared_resource_detail::AtomicOps<SharedResource, T>;
+
+    using Sequence = shared_resource_detail::Sequence<shared_resource_detail::UseSequenceLock<T>::value>;
+
+    using WriteLock = std::unique_lock<Mutex>;
+
+    using ReadLock = typename std::conditional<shared_resource_detail::IsSharedMutex<Mutex>::value,
+                                               shared_resource_detail::ReadLock<Mutex>,
+                                               std::unique_lock<Mutex>>::type;
+
+    using UpgradeLock = shared_resource_detail::UpgradeLock<Mutex>;
+
+    template<typename Lock, bool Writer>
+    class AccessorBase : private shared_resource_detail::HoldTimer<Instrumentation::enabled>
+    {
+        using Owner = typename std::conditional<Writer, SharedResource, const SharedResource>::type;
+        using Timer = shared_resource_detail::HoldTimer<Instrumentation::enabled>;
+
+        // While a condvar wait has the mutex released the accessor leaves its
+        // critical section, and re-enters it once the wait returns.
+        struct WaitGuard
+        {
+            WaitGuard(AccessorBase& accessor) : m_accessor(accessor)
+            {
+                m_accessor.leave();
+            }
+
+            ~WaitGuard()
+            {
+                m_accessor.enter();
+            }
+
+            AccessorBase &m_accessor;
+        };
+
+    public:
+        template<typename Cv, typename ...Args>
+        void wait(Cv& cv, Args&& ...args)
+        {
+            WaitGuard guard(*this);
+            cv.wait(m_lock, std::forward<Args>(args)...);
+        }
+
+        template<typename Cv, typename Rep, typename Period>
+        std::cv_status waitFor(Cv& cv, const std::chrono::duration<Rep,Period>& rel_time)
+        {
+            WaitGuard guard(*this);
+            return cv.wait_for(m_lock, rel_time);
+        }
+
+        template<typename Cv, typename Rep, typename Period, typename Predicate>
+        bool waitFor(Cv& cv, const std::chrono::duration<Rep,Period>& rel_time, Predicate pred)
+        {
+            WaitGuard guard(*this);
+            return cv.wait_for(m_lock, rel_time, pred);
+        }
+
+        template<typename Cv, typename Clock, typename Duration>
+        std::cv_status waitUntil(Cv& cv, const std::chrono::time_point<Clock,Duration>& abs_time)
+        {
+            WaitGuard guard(*this);
+            return cv.wait_until(m_lock, abs_time);
+        }
+
+        template<typename Cv, typename Clock, typename Duration, typename Predicate>
+        bool waitUntil(Cv& cv, const std::chrono::time_point<Clock,Duration>& abs_time, Predicate pred)
+        {
+            WaitGuard guard(*this);
+            return cv.wait_until(m_lock, abs_time, pred);
+        }
+
+        // Briefly releases the lock if other threads are blocked on it, so a
+        // long critical section can let short ones in. Returns whether the
+        // resource may have changed meanwhile, in which case pointers and
+        // iterators into it have to be revalidated.
+        bool relaxIfContended()
+        {
+            return m_owner && m_owner->contended() && yield();
+        }
+
+        // Like relaxIfContended(), but releases the lock unconditionally. If
+        // reacquiring it throws, the accessor is left invalid.
+        bool yield()
+        {
+            if (!m_owner)
+            {
+                return false;
+            }
+
+            auto owner = m_owner;
+            leave();
+            const auto stamp = owner->stamp();
+            const auto left = owner->waitersLeft();
+            const bool exclusive = releasesExclusive(owner);
+            m_lock.unlock();
+            owner->notifyReleased(exclusive);
+            owner->awaitHandoff(left);
+
+            try
+            {
+                owner->acquire(m_lock);
+            }
+            catch (...)
+            {
+                m_owner = nullptr;
+                throw;
+            }
+
+            enter();
+            if constexpr (Writer)
+            {
+                owner->drainDeferred();
+            }
+            return owner->stamp() != stamp;
+        }
+
+    protected:
+        AccessorBase(Owner *owner, Lock&& lock) :
+            m_lock(std::move(lock)),
+            m_owner(m_lock.owns_lock() ? owner : nullptr)
+        {
+            if (m_owner)
+            {
+                enter();
+            }
+        }
+
+        ~AccessorBase()
+        {
+            unlock();
+        }
+
+        // The hold time keeps running across moves.
+        AccessorBase(AccessorBase&& a) :
+            Timer(a),
+            m_lock(std::move(a.m_lock)),
+            m_owner(a.m_owner)
+        {
+            a.m_owner = nullptr;
+        }
+
+        AccessorBase& operator=(AccessorBase&& a)
+        {
+            if (&a != this)
+            {
+                unlock();
+                Timer::operator=(a);
+                m_lock = std::move(a.m_lock);
+                m_owner = a.m_owner;
+                a.m_owner = nullptr;
+            }
+            return *this;
+        }
+
+        void unlock() noexcept
+        {
+            if (auto owner = m_owner)
+            {
+                release();
+                const bool exclusive = releasesExclusive(owner);
+                m_lock.unlock();
+                owner->notifyReleased(exclusive);
+            }
+        }
+
+        // Called after leaving the critical section. An inner write section
+        // on a recursive mutex leaves the thread holding the lock.
+        static bool releasesExclusive(Owner *owner) noexcept
+        {
+            return Writer && owner->m_write_depth == 0;
+        }
+
+        // Leaves the critical section but keeps the mutex locked.
+        void release() noexcept
+        {
+            if (m_owner)
+            {
+                leave();
+            }
+            m_owner = nullptr;
+        }
+
+        void enter() noexcept
+        {
+            if constexpr (Writer)
+            {
+                m_owner->beginWrite();
+            }
+            this->startHold();
+        }
+
+        void leave() noexcept
+        {
+            this->stopHold(m_owner->instrumentation());
+            if constexpr (Writer)
+            {
+                m_owner->endWrite();
+            }
+        }
+
+        Lock    m_lock;
+        Owner   *m_owner;
+    };
+
+public:
+    template<typename ...Args>
+    SharedResource(Args&& ...args) : m_resource(std::forward<Args>(args)...)
+    {
+        // Registers for process-wide barriers here rather than on a release.
+        shared_resource_detail::asymmetricFences();
+    }
+
+    ~SharedResource()
+    {
+        if (auto extensions = m_extensions.load(std::memory_order_relaxed))
+        {
+            extensions->m_strand.runAll(&m_resource);
+            if (auto deferred = extensions->m_deferred.load(std::memory_order_relaxed))
+            {
+                deferred->drain(m_resource);
+            }
+            delete extensions;
+        }
+    }
+
+    SharedResource(SharedResource&&) = delete;
+    SharedResource(const SharedResource&) = delete;
+    SharedResource& operator=(SharedResource&&) = delete;
+    SharedResource& operator=(const SharedResource&) = delete;
+
+    class ConstAccessor;
+
+    template<typename Base, typename U>
+    class MappedAccessor;
+
+    class Accessor : public AccessorBase<WriteLock, true>
+    {
+        friend class SharedResource;
+        friend class ConstAccessor;
+        friend struct shared_resource_detail::LockAccess;
+
+        using Base = AccessorBase<WriteLock, true>;
+    public:
+        ~Accessor() = default;
+
+        Accessor(const Accessor&) = delete;
+        Accessor& operator=(const Accessor&) = delete;
+
+        Accessor(Accessor&& a) :
+            Base(std::move(a)),
+            m_shared_resource(a.m_shared_resource)
+        {
+            a.m_shared_resource = nullptr;
+        }
+
+        Accessor& operator=(Accessor&& a)
+        {
+            if (&a != this)
+            {
+                Base::operator=(std::move(a));
+                m_shared_resource = a.m_shared_resource;
+                a.m_shared_resource = nullptr;
+            }
+            return *this;
+        }
+
+        bool isValid() const noexcept
+        {
+            return Base::m_owner != nullptr;
+        }
+
+        T* operator->()
+        {
+            return m_shared_resource;
+        }
+
+        T& operator*()
+        {
+            return *m_shared_resource;
+        }
+
+        // Narrows the accessor to a part of T, keeping the lock. projection is
+        // a pointer to member or a callable returning a reference into T.
+        // This accessor becomes invalid.
+        template<typename Projection>
+        auto map(Projection projection)
+        {
+            return mapAccessor(std::move(*this), m_shared_resource, projection);
+        }
+
+        // Atomically trades the exclusive lock for a shared one: other
+        // readers can get in, but no writer. This accessor becomes invalid.
+        ConstAccessor downgrade()
+        {
+            static_assert(shared_resource_detail::CanDowngrade<Mutex>::value,
+                          "downgrade() needs a Mutex with unlock_and_lock_shared(), such as UpgradeMutex");
+            return ConstAccessor(std::move(*this));
+        }
+
+    private:
+        // Every exclusive acquisition first merges the deferred operations.
+        Accessor(SharedResource *resource, WriteLock&& lock) :
+            Base(resource, std::move(lock)),
+            m_shared_resource(Base::m_owner ? &resource->m_resource : nullptr)
+        {
+            if (m_shared_resource)
+            {
+                resource->drainDeferred();
+            }
+        }
+
+        // Ends the write section and hands the still locked mutex over.
+        WriteLock takeLock() noexcept
+        {
+            Base::release();
+            m_shared_resource = nullptr;
+            return std::move(Base::m_lock);
+        }
+
+        T   *m_shared_resource;
+    };
+
+
+    class ConstAccessor : public AccessorBase<ReadLock, false>
+    {
+        friend class SharedResource;
+        friend struct shared_resource_detail::LockAccess;
+
+        using Base = AccessorBase<ReadLock, false>;
+    public:
+        ~ConstAccessor() = default;
+
+        ConstAccessor(const ConstAccessor&) = delete;
+        ConstAccessor& operator=(const ConstAccessor&) = delete;
+
+        ConstAccessor(ConstAccessor&& a) :
+            Base(std::move(a)),
+            m_shared_resource(a.m_shared_resource)
+        {
+            a.m_shared_resource = nullptr;
+        }
+
+        ConstAccessor(Accessor&& a) :
+            ConstAccessor(std::move(a), a.m_shared_resource ? a.Accessor::Base::m_owner : nullptr) { }
+
+        ConstAccessor& operator=(ConstAccessor&& a)
+        {
+            if (&a != this)
+            {
+                Base::operator=(std::move(a));
+                m_shared_resource = a.m_shared_resource;
+                a.m_shared_resource = nullptr;
+            }
+            return *this;
+        }
+
+        ConstAccessor& operator=(Accessor&& a)
+        {
+            return *this = ConstAccessor(std::move(a));
+        }
+
+        bool isValid() const noexcept
+        {
+            return Base::m_owner != nullptr;
+        }
+
+        const T* operator->() const
+        {
+            return m_shared_resource;
+        }
+
+        const T& operator*() const
+        {
+            return *m_shared_resource;
+        }
+
+        // Read-only counterpart of Accessor::map().
+        template<typename Projection>
+        auto map(Projection projection)
+        {
+            return mapAccessor(std::move(*this), m_shared_resource, projection);
+        }
+
+    private:
+        ConstAccessor(const SharedResource *resource, ReadLock&& lock) :
+            Base(resource, std::move(lock)),
+            m_shared_resource(Base::m_owner ? &resource->m_resource : nullptr) { }
+
+        ConstAccessor(Accessor&& a, const SharedResource *resource) :
+            ConstAccessor(resource, adoptLock(a.takeLock())) { }
+
+        // Over a mutex that supports it the exclusive lock is downgraded, so
+        // a converted Accessor lets other readers in.
+        static ReadLock adoptLock(WriteLock&& lock)
+        {
+            ReadLock read_lock(std::move(lock));
+            if constexpr (shared_resource_detail::CanDowngrade<Mutex>::value)
+            {
+                read_lock.downgrade();
+            }
+            return read_lock;
+        }
+
+        const T *m_shared_resource;
+    };
+
+
+    // Read access that coexists with ConstAccessors but excludes writers and
+    // other upgradable accessors, so upgrade() can turn it into an Accessor
+    // without the resource changing in between.
+    class UpgradableAccessor : public AccessorBase<UpgradeLock, false>
+    {
+        friend class SharedResource;
+
+        using Base = AccessorBase<UpgradeLock, false>;
+    public:
+        ~UpgradableAccessor() = default;
+
+        UpgradableAccessor(const UpgradableAccessor&) = delete;
+        UpgradableAccessor& operator=(const UpgradableAccessor&) = delete;
+
+        UpgradableAccessor(UpgradableAccessor&& a) :
+            Base(std::move(a)),
+            m_shared_resource(a.m_shared_resource)
+        {
+            a.m_shared_resource = nullptr;
+        }
+
+        UpgradableAccessor& operator=(UpgradableAccessor&& a)
+        {
+            if (&a != this)
+            {
+                Base::operator=(std::move(a));
+                m_shared_resource = a.m_shared_resource;
+                a.m_shared_resource = nullptr;
+            }
+            return *this;
+        }
+
+        bool isValid() const noexcept
+        {
+            return Base::m_owner != nullptr;
+        }
+
+        const T* operator->() const
+        {
+            return m_shared_resource;
+        }
+
+        const T& operator*() const
+        {
+            return *m_shared_resource;
+        }
+
+        // Waits for the remaining readers to leave and returns exclusive
+        // access. This accessor becomes invalid.
+        Accessor upgrade()
+        {
+            // Only the non-const lockUpgradable() creates these.
+            auto owner = const_cast<SharedResource*>(Base::m_owner);
+            Base::release();
+            m_shared_resource = nullptr;
+            return Accessor(owner, Base::m_lock.upgrade());
+        }
+
+    private:
+        UpgradableAccessor(SharedResource *resource, UpgradeLock&& lock) :
+            Base(resource, std::move(lock)),
+            m_shared_resource(Base::m_owner ? &resource->m_resource : nullptr) { }
+
+        const T *m_shared_resource;
+    };
+
+
+    // Accessor or ConstAccessor narrowed to a part U of the resource. Holds
+    // the original accessor, and with it the lock, for as long as it lives.
+    template<typename Base, typename U>
+    class MappedAccessor
+    {
+        friend class SharedResource;
+    public:
+        ~MappedAccessor() = default;
+
+        MappedAccessor(const MappedAccessor&) = delete;
+        MappedAccessor& operator=(const MappedAccessor&) = delete;
+
+        MappedAccessor(MappedAccessor&& a) :
+            m_accessor(std::move(a.m_accessor)),
+            m_value(a.m_value)
+        {
+            a.m_value = nullptr;
+        }
+
+        MappedAccessor& operator=(MappedAccessor&& a)
+        {
+            if (&a != this)
+            {
+                m_accessor = std::move(a.m_accessor);
+                m_value = a.m_value;
+                a.m_value = nullptr;
+            }
+            return *this;
+        }
+
+        bool isValid() const noexcept
+        {
+            return m_value != nullptr;
+        }
+
+        U* operator->() const
+        {
+            return m_value;
+        }
+
+        U& operator*() const
+        {
+            return *m_value;
+        }
+
+        template<typename Projection>
+        auto map(Projection projection)
+        {
+            auto value = m_value;
+            m_value = nullptr;
+            return mapAccessor(std::move(m_accessor), value, projection);
+        }
+
+    private:
+        MappedAccessor(Base&& accessor, U *value) :
+            m_accessor(std::move(accessor)),
+            m_value(value) { }
+
+        Base    m_accessor;
+        U       *m_value;
+    };
+
+
+    Accessor lock()
+    {
+        WriteLock lock(m_mutex, std::defer_lock);
+        acquire(lock);
+        return Accessor(this, std::move(lock));
+    }
+
+
+    ConstAccessor lockConst() const
+    {
+        mergeDeferred();
+        ReadLock lock(m_mutex, std::defer_lock);
+        acquire(lock);
+        return ConstAccessor(this, std::move(lock));
+    }
+
+
+    Accessor tryLock()
+    {
+        WriteLock lock(m_mutex, std::defer_lock);
+        lock.try_lock();
+        return Accessor(this, std::move(lock));
+    }
+
+
+    template<typename Rep, typename Period>
+    Accessor tryLockFor(const std::chrono::duration<Rep,Period>& rel_time)
+    {
+        WriteLock lock(m_mutex, std::defer_lock);
+        tryAcquireFor(lock, rel_time);
+        return Accessor(this, std::move(lock));
+    }
+
+
+    template<typename Clock, typename Duration>
+    Accessor tryLockUntil(const std::chrono::time_point<Clock,Duration>& abs_time)
+    {
+        WriteLock lock(m_mutex, std::defer_lock);
+        tryAcquireUntil(lock, abs_time);
+        return Accessor(this, std::move(lock));
+    }
+
+
+    // Like lockConst(), the try variants first merge pending deferred
+    // operations under an exclusive lock, and fail if they cannot get it.
+    ConstAccessor tryLockConst() const
+    {
+        ReadLock lock(m_mutex, std::defer_lock);
+        if (tryMergeDeferred())
+        {
+            lock.try_lock();
+        }
+        return ConstAccessor(this, std::move(lock));
+    }
+
+
+    template<typename Rep, typename Period>
+    ConstAccessor tryLockConstFor(const std::chrono::duration<Rep,Period>& rel_time) const
+    {
+        return tryLockConstUntil(std::chrono::steady_clock::now() + rel_time);
+    }
+
+
+    template<typename Clock, typename Duration>
+    ConstAccessor tryLockConstUntil(const std::chrono::time_point<Clock,Duration>& abs_time) const
+    {
+        ReadLock lock(m_mutex, std::defer_lock);
+        if (tryMergeDeferredUntil(abs_time))
+        {
+            tryAcquireUntil(lock, abs_time);
+        }
+        return ConstAccessor(this, std::move(lock));
+    }
+
+#if defined(__cpp_lib_jthread)
+    template<typename Rep, typename Period>
+    Accessor tryLockFor(const std::chrono::duration<Rep,Period>& rel_time, std::stop_token stop)
+    {
+        return tryLockUntil(std::chrono::steady_clock::now() + rel_time, std::move(stop));
+    }
+
+
+    template<typename Clock, typename Duration>
+    Accessor tryLockUntil(const std::chrono::time_point<Clock,Duration>& abs_time, std::stop_token stop)
+    {
+        WriteLock lock(m_mutex, std::defer_lock);
+        tryAcquireUntil(lock, abs_time, stop);
+        return Accessor(this, std::move(lock));
+    }
+
+
+    template<typename Rep, typename Period>
+    ConstAccessor tryLockConstFor(const std::chrono::duration<Rep,Period>& rel_time, std::stop_token stop) const
+    {
+        return tryLockConstUntil(std::chrono::steady_clock::now() + rel_time, std::move(stop));
+    }
+
+
+    template<typename Clock, typename Duration>
+    ConstAccessor tryLockConstUntil(const std::chrono::time_point<Clock,Duration>& abs_time, std::stop_token stop) const
+    {
+        ReadLock lock(m_mutex, std::defer_lock);
+        if (tryMergeDeferredUntil(abs_time, stop))
+        {
+            tryAcquireUntil(lock, abs_time, stop);
+        }
+        return ConstAccessor(this, std::move(lock));
+    }
+#endif
+
+    UpgradableAccessor lockUpgradable()
+    {
+        static_assert(shared_resource_detail::IsUpgradeMutex<Mutex>::value,
+                      "lockUpgradable() needs an upgradable Mutex, such as UpgradeMutex");
+        mergeDeferred();
+        UpgradeLock lock(m_mutex, std::defer_lock);
+        acquire(lock);
+        return UpgradableAccessor(this, std::move(lock));
+    }
+
+
+    UpgradableAccessor tryLockUpgradable()
+    {
+        static_assert(shared_resource_detail::IsUpgradeMutex<Mutex>::value,
+                      "tryLockUpgradable() needs an upgradable Mutex, such as UpgradeMutex");
+        UpgradeLock lock(m_mutex, std::defer_lock);
+        if (tryMergeDeferred())
+        {
+            lock.try_lock();
+        }
+        return UpgradableAccessor(this, std::move(lock));
+    }
+
+    // Returns a copy of the resource. For small trivially copyable T this is
+    // an optimistic seqlock read that never writes shared memory; otherwise
+    // the copy is made under lockConst(). A lock-free std::atomic<U> is
+    // loaded directly and returned as U.
+    auto load() const
+    {
+        mergeDeferred();
+
+        if constexpr (shared_resource_detail::IsLockFreeAtomic<T>::value)
+        {
+            return m_resource.load();
+        }
+        else if constexpr (shared_resource_detail::UseSequenceLock<T>::value)
+        {
+            return Sequence::read(m_resource, [this] { return *lockConst(); });
+        }
+        else
+        {
+            return *lockConst();
+        }
+    }
+
+#if defined(SHARED_RESOURCE_HAS_COROUTINES)
+    template<bool Writer, typename Schedule>
+    class LockAwaiter : private shared_resource_detail::AsyncWaiter
+    {
+        using Owner = typename std::conditional<Writer, SharedResource, const SharedResource>::type;
+        using Lock = typename std::conditional<Writer, WriteLock, ReadLock>::type;
+        using Result = typename std::conditional<Writer, Accessor, ConstAccessor>::type;
+
+    public:
+        LockAwaiter(Owner *owner, Schedule schedule) :
+            shared_resource_detail::AsyncWaiter{&wake, !Writer},
+            m_owner(owner),
+            m_schedule(std::move(schedule)),
+            m_lock(owner->m_mutex, std::defer_lock) { }
+
+        ~LockAwaiter()
+        {
+            if (m_retry)
+            {
+                m_retry.destroy();
+            }
+        }
+
+        LockAwaiter(const LockAwaiter&) = delete;
+        LockAwaiter& operator=(const LockAwaiter&) = delete;
+
+        // Queued waiters are served first, so a newcomer only takes the fast
+        // path when nobody is waiting.
+        bool await_ready()
+        {
+            return m_owner->asyncQueueEmpty() && tryAcquire();
+        }
+
+        // The retry coroutine is created up front: once queued, the awaiter
+        // may be woken before enqueue() even returns.
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            m_owner->prime();
+            auto retry = retryAcquire(this);
+            retry.m_handle.promise().m_continuation = handle;
+            m_retry = retry.m_handle;
+
+            if (m_owner->asyncQueue().enqueue(this, [this] { return tryAcquire(); }))
+            {
+                return true;
+            }
+
+            m_retry.destroy();
+            m_retry = nullptr;
+            return false;
+        }
+
+        // Either await_ready() or await_suspend() got the lock, or the retry
+        // coroutine did before transferring here.
+        Result await_resume()
+        {
+            return Result(m_owner, std::move(m_lock));
+        }
+
+    private:
+        // Readers merge pending deferred operations first, see lockConst().
+        bool tryAcquire()
+        {
+            if constexpr (!Writer)
+            {
+                if (!m_owner->tryMergeDeferredQuietly())
+                {
+                    return false;
+                }
+            }
+            return m_lock.try_lock();
+        }
+
+        // Queues the awaiter again, at the front, after it lost the lock
+        // it was woken for. Does not suspend if the lock is free by now.
+        struct Requeue
+        {
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+
+            bool await_suspend(std::coroutine_handle<>)
+            {
+                return m_awaiter->m_owner->asyncQueue().enqueue(
+                    m_awaiter, [awaiter = m_awaiter] { return awaiter->tryAcquire(); }, true);
+            }
+
+            void await_resume() noexcept { }
+
+            LockAwaiter *m_awaiter;
+        };
+
+        // Runs wherever schedule resumes the woken awaiter, so the lock is
+        // taken, and later released, on that thread.
+        static shared_resource_detail::AsyncRetry retryAcquire(LockAwaiter *self)
+        {
+            while (!self->m_lock.owns_lock() && !self->tryAcquire())
+            {
+                co_await Requeue{self};
+            }
+        }
+
+        static void wake(shared_resource_detail::AsyncWaiter *waiter) noexcept
+        {
+            auto self = static_cast<LockAwaiter*>(waiter);
+            self->m_schedule(self->m_retry);
+        }
+
+        Owner                   *m_owner;
+        Schedule                m_schedule;
+        Lock                    m_lock;
+        std::coroutine_handle<> m_retry;
+    };
+
+    // co_await resource.lockAsync() suspends the coroutine instead of blocking
+    // the thread while the mutex is busy. Waiters are queued in FIFO order and
+    // woken when an accessor is released (not while it waits on a condvar).
+    // schedule(handle) decides where the coroutine resumes, e.g. by posting
+    // the handle to the caller's executor; by default it resumes inline on
+    // the releasing thread. A woken waiter takes the lock itself once it
+    // runs, and queues up again at the front if another thread beat it to
+    // it. Mutex has to be unlocked by the thread that locked it, so do not
+    // co_await while holding the accessor unless the executor resumes on
+    // the same thread.
+    template<typename Schedule = shared_resource_detail::ResumeInline>
+    LockAwaiter<true, Schedule> lockAsync(Schedule schedule = Schedule())
+    {
+        return LockAwaiter<true, Schedule>(this, std::move(schedule));
+    }
+
+
+    template<typename Schedule = shared_resource_detail::ResumeInline>
+    LockAwaiter<false, Schedule> lockConstAsync(Schedule schedule = Schedule()) const
+    {
+        return LockAwaiter<false, Schedule>(this, std::move(schedule));
+    }
+#endif
+
+    // Runs func(T&) under the lock and returns its result. Concurrent apply()
+    // calls are flat-combined: each publishes its call in a slot, and the
+    // thread that gets the lock runs every published call in one batch. func
+    // may therefore run on another thread; exceptions are passed back to the
+    // caller. A caller that spins without finding the lock free takes its
+    // call back and blocks in lock() instead.
+    template<typename Func>
+    auto apply(Func&& func) -> typename std::invoke_result<Func&, T&>::type
+    {
+        using Result = typename std::invoke_result<Func&, T&>::type;
+        static_assert(!std::is_reference<Result>::value,
+                      "apply() must return by value: the lock is released before it returns");
+
+        auto& combiner = this->combiner();
+        shared_resource_detail::CombinedCall<T, Func, Result> call(func);
+
+        if (!combiner.publish(&call))
+        {
+            auto accessor = lock();
+            return std::invoke(func, *accessor);
+        }
+
+        for (unsigned attempt = 0; !call.m_done.load(std::memory_order_acquire); ++attempt)
+        {
+            auto accessor = tryLock();
+            if (accessor.isValid())
+            {
+                combiner.combine(*accessor);
+            }
+            else if (attempt < 64)
+            {
+                shared_resource_detail::cpuRelax();
+            }
+            else if (combiner.retract(&call))
+            {
+                auto accessor = lock();
+                combiner.combine(*accessor);
+                return std::invoke(func, *accessor);
+            }
+            else
+            {
+                // A combiner has claimed the call and is running it.
+                std::this_thread::yield();
+            }
+        }
+        return call.result();
+    }
+
+
+    // Reads are not combined: func(const T&) runs under lockConst(), which
+    // lets readers run in parallel when Mutex supports shared locking.
+    template<typename Func>
+    auto applyConst(Func&& func) const -> typename std::invoke_result<Func&, const T&>::type
+    {
+        using Result = typename std::invoke_result<Func&, const T&>::type;
+        static_assert(!std::is_reference<Result>::value,
+                      "applyConst() must return by value: the lock is released before it returns");
+
+        auto accessor = lockConst();
+        return std::invoke(func, *accessor);
+    }
+
+    // Queues func(T&) to run later under the lock, without taking it now.
+    // Pending operations are merged in one batch by the next acquisition of
+    // any kind, by load(), or here once the calling thread's buffer fills
+    // up; shared acquisitions take the lock exclusively once to do so.
+    // Operations from one thread run in order, but there is no order across
+    // threads, so they should commute. They must not throw.
+    template<typename Func>
+    void defer(Func&& func)
+    {
+        if (deferBuffer().push(std::forward<Func>(func)))
+        {
+            lock();
+        }
+    }
+
+    // Merges all pending deferred operations now.
+    void flush()
+    {
+        lock();
+    }
+
+    using Executor = typename shared_resource_detail::Strand<T>::Executor;
+
+    // Makes post() hand draining over to executor, which is called with a
+    // task that takes the lock and runs everything queued. Has to be set
+    // before the first post(), and the executor must have run all tasks it
+    // was given before the resource is destroyed.
+    void setExecutor(Executor executor)
+    {
+        extensions().m_strand.m_executor = std::move(executor);
+    }
+
+    // Queues func(T&) to run exclusively on the resource and returns without
+    // waiting for the lock. Posted functions run one at a time in the order
+    // they were queued. Without an executor they are drained right here if
+    // the lock is free, and otherwise by whoever next releases it
+    // exclusively. They must not throw; use submit() to get at results or
+    // exceptions. Must not be called while the calling thread holds the
+    // lock, except from within a posted function.
+    template<typename Func>
+    void post(Func func)
+    {
+        auto& strand = extensions().m_strand;
+        if (!strand.m_executor)
+        {
+            prime();
+        }
+        strand.push(new typename shared_resource_detail::Strand<T>::template Call<Func>(std::move(func)));
+        if (!strand.m_executor)
+        {
+            drainStrand();
+        }
+        else if (strand.schedule())
+        {
+            strand.m_executor([this] { runScheduled(); });
+        }
+    }
+
+    // Like post(), but the result of func(T&) or the exception it threw is
+    // handed back through the returned future.
+    template<typename Func>
+    auto submit(Func func) -> std::future<typename std::invoke_result<Func&, T&>::type>
+    {
+        using Result = typename std::invoke_result<Func&, T&>::type;
+
+        std::promise<Result> promise;
+        auto future = promise.get_future();
+        post([func = std::move(func), promise = std::move(promise)](T& value) mutable
+        {
+            try
+            {
+                if constexpr (std::is_void<Result>::value)
+                {
+                    std::invoke(func, value);
+                    promise.set_value();
+                }
+                else
+                {
+                    promise.set_value(std::invoke(func, value));
+                }
+            }
+            catch (...)
+            {
+                promise.set_exception(std::current_exception());
+            }
+        });
+        return future;
+    }
+
+    // Number of completed write sections. Bumped whenever a mutable
+    // Accessor is released, converted to a ConstAccessor or starts a condvar
+    // wait, so readers can cheaply tell whether anything may have changed.
+    std::uint64_t version() const noexcept
+    {
+        return m_version.load(std::memory_order_acquire);
+    }
+
+#if defined(__cpp_lib_atomic_wait)
+    // Blocks until version() differs from last_version and returns the new
+    // version. Waiters park on the version counter itself and are only woken
+    // by a write, never by readers.
+    std::uint64_t waitChanged(std::uint64_t last_version) const
+    {
+        m_version_waiters.fetch_add(1, std::memory_order_seq_cst);
+        m_version.wait(last_version, std::memory_order_seq_cst);
+        m_version_waiters.fetch_sub(1, std::memory_order_relaxed);
+        return version();
+    }
+
+    // Blocks until pred(const T&) holds and returns the ConstAccessor under
+    // which it was checked. The predicate is re-evaluated after each write.
+    template<typename Predicate>
+    ConstAccessor waitFor(Predicate pred) const
+    {
+        for (;;)
+        {
+            std::uint64_t seen;
+            {
+                auto accessor = lockConst();
+                if (std::invoke(pred, *accessor))
+                {
+                    return accessor;
+                }
+                seen = version();
+            }
+            waitChanged(seen);
+        }
+    }
+#endif
+
+    // Names this resource in the instrumentation output. A no-op unless an
+    // instrumentation policy is in use.
+    void setName(const char *name) const
+    {
+        Instrumentation::setName(name);
+    }
+
+private:
+    const Instrumentation& instrumentation() const noexcept
+    {
+        return *this;
+    }
+
+    shared_resource_detail::Extensions<T>& extensions() const
+    {
+        return shared_resource_detail::lazyCreate(m_extensions);
+    }
+
+    shared_resource_detail::Combiner<T>& combiner()
+    {
+        return shared_resource_detail::lazyCreate(extensions().m_combiner);
+    }
+
+    shared_resource_detail::DeferBuffer<T>& deferBuffer()
+    {
+        return shared_resource_detail::lazyCreate(extensions().m_deferred);
+    }
+
+    // Until the first post() or suspended lockAsync(), releases skip the
+    // checks of notifyReleased() and, given asymmetric fences, its fence.
+    // Priming turns them on; the process-wide barrier makes sure that a lock
+    // holder that skipped them has visibly released the lock by the time the
+    // caller goes on to try it.
+    void prime() const
+    {
+        auto& extensions = this->extensions();
+        if (!extensions.m_primed.load(std::memory_order_acquire))
+        {
+            extensions.m_hooked.store(true, std::memory_order_seq_cst);
+            shared_resource_detail::processBarrier();
+            extensions.m_primed.store(true, std::memory_order_release);
+        }
+    }
+
+    // A poster that fails to get the lock leaves its task to the holder, who
+    // checks the queue after unlocking. Both sides use sequentially
+    // consistent operations, so one of them always sees the other. Releases
+    // within a drain only loop back here, rather than recursing. A drain
+    // stops after a few batches, so tasks that keep posting more cannot
+    // trap the releasing thread; the rest waits for the next release.
+    void drainStrand() noexcept
+    {
+        thread_local const SharedResource *draining = nullptr;
+        if (draining == this)
+        {
+            return;
+        }
+
+        auto previous = std::exchange(draining, this);
+        auto strand = &m_extensions.load(std::memory_order_acquire)->m_strand;
+        for (unsigned batch = 0; batch < strand->drainBatches && !strand->empty(); ++batch)
+        {
+            auto accessor = tryLock();
+            if (!accessor.isValid())
+            {
+                break;
+            }
+            strand->runAll(&*accessor);
+        }
+        draining = previous;
+    }
+
+    void runScheduled()
+    {
+        auto strand = &m_extensions.load(std::memory_order_acquire)->m_strand;
+        do
+        {
+            auto accessor = lock();
+            strand->runAll(&*accessor);
+        }
+        while (strand->finish());
+    }
+
+    shared_resource_detail::DeferBuffer<T>* deferred() const noexcept
+    {
+        auto extensions = m_extensions.load(std::memory_order_acquire);
+        return extensions ? extensions->m_deferred.load(std::memory_order_acquire) : nullptr;
+    }
+
+    bool hasDeferred() const noexcept
+    {
+        auto deferred = this->deferred();
+        return deferred && !deferred->empty();
+    }
+
+    void drainDeferred()
+    {
+        if (hasDeferred())
+        {
+            deferred()->drain(m_resource);
+        }
+    }
+
+    // Shared acquisitions cannot merge deferred operations themselves, so
+    // they first take the lock exclusively once if any are pending.
+    void mergeDeferred() const
+    {
+        if (hasDeferred())
+        {
+            mutableThis()->lock();
+        }
+    }
+
+    // Returns false if operations are pending and the lock is busy.
+    bool tryMergeDeferred() const
+    {
+        return !hasDeferred() || mutableThis()->tryLock().isValid();
+    }
+
+    template<typename Clock, typename Duration>
+    bool tryMergeDeferredUntil(const std::chrono::time_point<Clock,Duration>& abs_time) const
+    {
+        return !hasDeferred() || mutableThis()->tryLockUntil(abs_time).isValid();
+    }
+
+#if defined(__cpp_lib_jthread)
+    template<typename Clock, typename Duration>
+    bool tryMergeDeferredUntil(const std::chrono::time_point<Clock,Duration>& abs_time,
+                               const std::stop_token& stop) const
+    {
+        return !hasDeferred() || mutableThis()->tryLockUntil(abs_time, stop).isValid();
+    }
+#endif
+
+#if defined(SHARED_RESOURCE_HAS_COROUTINES)
+    // Variant of tryMergeDeferred() for the lockAsync() queue. It locks
+    // without an Accessor, whose release would reenter the queue; the shared
+    // lock that the caller takes next wakes the other waiters instead.
+    bool tryMergeDeferredQuietly() const
+    {
+        if (!hasDeferred())
+        {
+            return true;
+        }
+
+        WriteLock lock(m_mutex, std::try_to_lock);
+        if (!lock.owns_lock())
+        {
+            return false;
+        }
+
+        auto self = mutableThis();
+        self->beginWrite();
+        self->drainDeferred();
+        self->endWrite();
+        return true;
+    }
+#endif
+
+    // Changes whenever the resource may have changed. Unlike version() it
+    // also covers deferred operations merged into a write section that is
+    // still in progress.
+    std::uint64_t stamp() const noexcept
+    {
+        auto deferred = this->deferred();
+        return version() + (deferred ? deferred->drains() : 0);
+    }
+
+    // Deferred and posted operations can only be pending on a resource that
+    // defer() or post() was called on, which is never a const object, so
+    // running them from a const member function is fine.
+    SharedResource* mutableThis() const noexcept
+    {
+        return const_cast<SharedResource*>(this);
+    }
+
+    template<typename Base, typename V, typename Projection>
+    static auto mapAccessor(Base&& accessor, V *value, Projection& projection)
+    {
+        using Result = typename std::invoke_result<Projection&, V&>::type;
+        static_assert(std::is_lvalue_reference<Result>::value,
+                      "map() needs a projection that returns a reference into the resource");
+
+        using U = typename std::remove_reference<Result>::type;
+        U *mapped = value ? &std::invoke(projection, *value) : nullptr;
+        return MappedAccessor<Base, U>(std::move(accessor), mapped);
+    }
+
+    // Only the release of an exclusive lock drains posted tasks; readers
+    // leave them to the next writer, post() or flush().
+    void notifyReleased(bool exclusive) const noexcept
+    {
+        if (shared_resource_detail::asymmetricFences())
+        {
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            auto extensions = m_extensions.load(std::memory_order_acquire);
+            if (!extensions || !extensions->m_hooked.load(std::memory_order_relaxed))
+            {
+                return;
+            }
+        }
+
+        // The unlock may only be a release store. The fence keeps the checks
+        // below from moving ahead of it and pairs with the fences in
+        // Strand::push() and AsyncQueue::enqueue().
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        auto extensions = m_extensions.load(std::memory_order_acquire);
+        if (!extensions)
+        {
+            return;
+        }
+
+        auto& strand = extensions->m_strand;
+        if (exclusive && !strand.m_executor && !strand.empty())
+        {
+            mutableThis()->drainStrand();
+        }
+#if defined(SHARED_RESOURCE_HAS_COROUTINES)
+        extensions->m_async_queue.wakeNext();
+#endif
+    }
+
+#if defined(SHARED_RESOURCE_HAS_COROUTINES)
+    shared_resource_detail::AsyncQueue& asyncQueue() const
+    {
+        return extensions().m_async_queue;
+    }
+
+    bool asyncQueueEmpty() const noexcept
+    {
+        auto extensions = m_extensions.load(std::memory_order_acquire);
+        return !extensions || extensions->m_async_queue.empty();
+    }
+#endif
+
+    // Threads that had to block are counted, so that accessors can tell
+    // whether anybody is waiting for them.
+    template<typename Lock>
+    void acquire(Lock& lock) const
+    {
+        if (lock.try_lock())
+        {
+            if constexpr (Instrumentation::enabled)
+            {
+                Instrumentation::recordAcquisition(false, std::chrono::nanoseconds::zero());
+            }
+            return;
+        }
+
+        shared_resource_detail::WaiterCount waiter_count(waiters());
+
+        if constexpr (Instrumentation::enabled)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            lock.lock();
+            Instrumentation::recordAcquisition(true, std::chrono::steady_clock::now() - start);
+        }
+        else
+        {
+            lock.lock();
+        }
+    }
+
+    // Created by the first thread that has to block.
+    shared_resource_detail::LockWaiters& waiters() const
+    {
+        return extensions().m_waiters;
+    }
+
+    std::uint32_t waitersLeft() const noexcept
+    {
+        auto extensions = m_extensions.load(std::memory_order_acquire);
+        return extensions ? extensions->m_waiters.m_left.load(std::memory_order_acquire) : 0;
+    }
+
+    bool contended() const noexcept
+    {
+        auto extensions = m_extensions.load(std::memory_order_acquire);
+        if (!extensions)
+        {
+            return false;
+        }
+#if defined(SHARED_RESOURCE_HAS_COROUTINES)
+        if (!extensions->m_async_queue.empty())
+        {
+            return true;
+        }
+#endif
+        return extensions->m_waiters.m_blocked.load(std::memory_order_relaxed) != 0;
+    }
+
+    template<typename Lock, typename Rep, typename Period>
+    void tryAcquireFor(Lock& lock, const std::chrono::duration<Rep,Period>& rel_time) const
+    {
+        if (!lock.try_lock())
+        {
+            shared_resource_detail::WaiterCount waiter_count(waiters());
+            lock.try_lock_for(rel_time);
+        }
+    }
+
+    template<typename Lock, typename Clock, typename Duration>
+    void tryAcquireUntil(Lock& lock, const std::chrono::time_point<Clock,Duration>& abs_time) const
+    {
+        if (!lock.try_lock())
+        {
+            shared_resource_detail::WaiterCount waiter_count(waiters());
+            lock.try_lock_until(abs_time);
+        }
+    }
+
+#if defined(__cpp_lib_jthread)
+    template<typename Lock, typename Clock, typename Duration>
+    void tryAcquireUntil(Lock& lock, const std::chrono::time_point<Clock,Duration>& abs_time,
+                         const std::stop_token& stop) const
+    {
+        if (!lock.try_lock())
+        {
+            shared_resource_detail::WaiterCount waiter_count(waiters());
+            shared_resource_detail::lockUntil(lock, abs_time, stop);
+        }
+    }
+#endif
+
+    // Called by yield() right after unlocking. A barging mutex would usually
+    // let the releasing thread take the lock straight back before a woken
+    // waiter gets to run, so give blocked threads a bounded chance to get in.
+    void awaitHandoff(std::uint32_t left) const
+    {
+        auto extensions = m_extensions.load(std::memory_order_acquire);
+        if (!extensions)
+        {
+            return;
+        }
+
+        auto& waiters = extensions->m_waiters;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(1);
+        for (unsigned spin = 0; waiters.m_blocked.load(std::memory_order_relaxed) != 0 &&
+                                waiters.m_left.load(std::memory_order_acquire) == left; ++spin)
+        {
+            if (spin < 64)
+            {
+                shared_resource_detail::cpuRelax();
+            }
+            else if (std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                break;
+            }
+        }
+    }
+
+    // Over a recursive mutex write sections nest; only the outermost one
+    // counts, so that load() keeps waiting until all of them are done.
+    void beginWrite() noexcept
+    {
+        if (m_write_depth++ == 0)
+        {
+            Sequence::beginWrite();
+        }
+    }
+
+    void endWrite() noexcept
+    {
+        if (--m_write_depth != 0)
+        {
+            return;
+        }
+
+        Sequence::endWrite();
+
+        m_version.fetch_add(1, std::memory_order_seq_cst);
+#if defined(__cpp_lib_atomic_wait)
+        if (m_version_waiters.load(std::memory_order_seq_cst) != 0)
+        {
+            m_version.notify_all();
+        }
+#endif
+    }
+
+    T                                                           m_resource;
+    mutable Mutex                                               m_mutex;
+    mutable std::atomic<shared_resource_detail::Extensions<T>*> m_extensions{nullptr};
+    std::atomic<std::uint64_t>                                  m_version{0};
+    unsigned                                                    m_write_depth = 0;
+#if defined(__cpp_lib_atomic_wait)
+    mutable std::atomic<std::uint32_t>                          m_version_waiters{0};
+#endif
+};
+
+namespace shared_resource_detail
+{
+    struct LockAccess
+    {
+        template<typename Resource>
+        static auto deferLock(Resource& resource)
+        {
+            if constexpr (std::is_const<Resource>::value)
+            {
+                return typename Resource::ReadLock(resource.m_mutex, std::defer_lock);
+            }
+            else
+            {
+                return typename Resource::WriteLock(resource.m_mutex, std::defer_lock);
+            }
+        }
+
+        template<typename Resource, typename Lock>
+        static auto makeAccessor(Resource& resource, Lock&& lock)
+        {
+            if constexpr (std::is_const<Resource>::value)
+            {
+                return typename Resource::ConstAccessor(&resource, std::move(lock));
+            }
+            else
+            {
+                return typename Resource::Accessor(&resource, std::move(lock));
+            }
+        }
+
+        template<typename Resource>
+        static std::uint64_t stamp(const Resource& resource) noexcept
+        {
+            return resource.stamp();
+        }
+
+        template<typename Resource>
+        static LockWaiters& waiters(Resource& resource)
+        {
+            return resource.waiters();
+        }
+
+        // Mutable resources merge deferred operations in their Accessor.
+        template<typename Resource>
+        static void mergeDeferred(Resource& resource)
+        {
+            if constexpr (std::is_const<Resource>::value)
+            {
+                resource.mergeDeferred();
+            }
+        }
+
+        template<typename Resource>
+        static bool tryMergeDeferred(Resource& resource)
+        {
+            if constexpr (std::is_const<Resource>::value)
+            {
+                return resource.tryMergeDeferred();
+            }
+            return true;
+        }
+
+        template<typename Resource, typename Clock, typename Duration>
+        static bool tryMergeDeferredUntil(Resource& resource, const std::chrono::time_point<Clock,Duration>& abs_time)
+        {
+            if constexpr (std::is_const<Resource>::value)
+            {
+                return resource.tryMergeDeferredUntil(abs_time);
+            }
+            return true;
+        }
+    };
+
+    template<typename Tuple, typename Func, std::size_t ...I>
+    void visitAt(Tuple& tuple, std::size_t index, Func&& func, std::index_sequence<I...>)
+    {
+        ((I == index ? (void)func(std::get<I>(tuple)) : (void)0), ...);
+    }
+
+    template<typename ...Locks>
+    void unlockOwned(std::tuple<Locks...>& locks)
+    {
+        std::apply([](auto& ...lock) { ((lock.owns_lock() ? lock.unlock() : (void)0), ...); }, locks);
+    }
+
+    // Timed counterpart of std::lock: block (with a deadline) on one lock,
+    // try the rest, and on failure back off and start from the lock that failed.
+    template<typename Clock, typename Duration, typename ...Locks>
+    bool lockAllUntil(const std::chrono::time_point<Clock,Duration>& abs_time, std::tuple<Locks...>& locks)
+    {
+        constexpr std::size_t count = sizeof...(Locks);
+        const auto indices = std::index_sequence_for<Locks...>();
+
+        std::size_t first = 0;
+        for (;;)
+        {
+            bool locked = false;
+            visitAt(locks, first, [&](auto& lock) { locked = lock.try_lock_until(abs_time); }, indices);
+            if (!locked)
+            {
+                return false;
+            }
+
+            std::size_t failed = count;
+            for (std::size_t n = 1; n < count && failed == count; ++n)
+            {
+                const std::size_t index = (first + n) % count;
+                visitAt(locks, index, [&](auto& lock) { locked = lock.try_lock(); }, indices);
+                if (!locked)
+                {
+                    failed = index;
+                }
+            }
+
+            if (failed == count)
+            {
+                return true;
+            }
+
+            unlockOwned(locks);
+            first = failed;
+            std::this_thread::yield();
+        }
+    }
+
+    // Either locks all of them or none.
+    template<typename ...Locks>
+    bool tryLockEach(std::tuple<Locks...>& locks)
+    {
+        if constexpr (sizeof...(Locks) == 1)
+        {
+            return std::get<0>(locks).try_lock();
+        }
+        else
+        {
+            return std::apply([](auto& ...lock) { return std::try_lock(lock...) == -1; }, locks);
+        }
+    }
+
+    template<typename ...Locks, typename ...Resources, std::size_t ...I>
+    auto makeAccessors(std::tuple<Locks...>& locks, std::index_sequence<I...>, Resources& ...resources)
+    {
+        return std::make_tuple(LockAccess::makeAccessor(resources, std::move(std::get<I>(locks)))...);
+    }
+}
+
+// Locks every resource using a deadlock avoidance algorithm and returns a
+// tuple of accessors: Accessor for mutable resources, ConstAccessor for const
+// ones. The same resource must not be passed twice.
+template<typename ...Resources>
+auto lockAll(Resources& ...resources)
+{
+    using shared_resource_detail::LockAccess;
+    static_assert(sizeof...(Resources) > 0, "lockAll() needs at least one resource");
+
+    (LockAccess::mergeDeferred(resources), ...);
+    auto locks = std::make_tuple(LockAccess::deferLock(resources)...);
+    if (!shared_resource_detail::tryLockEach(locks))
+    {
+        std::tuple<shared_resource_detail::WaiterCountOf<Resources>...> waiter_counts(LockAccess::waiters(resources)...);
+        if constexpr (sizeof...(Resources) == 1)
+        {
+            std::get<0>(locks).lock();
+        }
+        else
+        {
+            std::apply([](auto& ...lock) { std::lock(lock...); }, locks);
+        }
+    }
+    return shared_resource_detail::makeAccessors(locks, std::index_sequence_for<Resources...>(), resources...);
+}
+
+
+// Either every returned accessor is valid or none of them is.
+template<typename ...Resources>
+auto tryLockAll(Resources& ...resources)
+{
+    using shared_resource_detail::LockAccess;
+    static_assert(sizeof...(Resources) > 0, "tryLockAll() needs at least one resource");
+
+    auto locks = std::make_tuple(LockAccess::deferLock(resources)...);
+    if ((LockAccess::tryMergeDeferred(resources) && ...))
+    {
+        shared_resource_detail::tryLockEach(locks);
+    }
+    return shared_resource_detail::makeAccessors(locks, std::index_sequence_for<Resources...>(), resources...);
+}
+
+
+template<typename Clock, typename Duration, typename ...Resources>
+auto tryLockAllUntil(const std::chrono::time_point<Clock,Duration>& abs_time, Resources& ...resources)
+{
+    using shared_resource_detail::LockAccess;
+    static_assert(sizeof...(Resources) > 0, "tryLockAllUntil() needs at least one resource");
+
+    auto locks = std::make_tuple(LockAccess::deferLock(resources)...);
+    if ((LockAccess::tryMergeDeferredUntil(resources, abs_time) && ...) &&
+        !shared_resource_detail::tryLockEach(locks))
+    {
+        std::tuple<shared_resource_detail::WaiterCountOf<Resources>...> waiter_counts(LockAccess::waiters(resources)...);
+        shared_resource_detail::lockAllUntil(abs_time, locks);
+    }
+    return shared_resource_detail::makeAccessors(locks, std::index_sequence_for<Resources...>(), resources...);
+}
+
+
+template<typename Rep, typename Period, typename ...Resources>
+auto tryLockAllFor(const std::chrono::duration<Rep,Period>& rel_time, Resources& ...resources)
+{
+    return tryLockAllUntil(std::chrono::steady_clock::now() + rel_time, resources...);
+}
+
+namespace shared_resource_detail
+{
+    template<typename Resource>
+    using ResourceValue = typename std::remove_const<typename std::remove_reference<
+        decltype(*std::declval<const Resource&>().lockConst())>::type>::type;
+
+    // What transaction() hands to its function: a private copy of a mutable
+    // resource, a read-only one of a const resource.
+    template<typename Resource>
+    using TransactionValue = typename std::conditional<std::is_const<Resource>::value,
+                                                       const ResourceValue<Resource>,
+                                                       ResourceValue<Resource>>::type;
+
+    constexpr unsigned optimisticAttempts = 8;
+
+    // Copies the resource together with its stamp. Writers are held off only
+    // for the copy.
+    template<typename Resource>
+    ResourceValue<Resource> snapshot(const Resource& resource, std::uint64_t& stamp)
+    {
+        auto accessor = resource.lockConst();
+        stamp = LockAccess::stamp(resource);
+        return *accessor;
+    }
+
+    template<std::size_t Index, typename Value, typename Accessors>
+    void commitValue(Value& value, Accessors& accessors)
+    {
+        if constexpr (!std::is_const<Value>::value)
+        {
+            *std::get<Index>(accessors) = std::move(value);
+        }
+    }
+
+    template<typename Func, std::size_t ...I, typename ...Resources>
+    auto transaction(Func& func, std::index_sequence<I...>, Resources& ...resources)
+    {
+        using Result = typename std::invoke_result<Func&, TransactionValue<Resources>&...>::type;
+
+        for (unsigned attempt = 0; attempt < optimisticAttempts; ++attempt)
+        {
+            std::array<std::uint64_t, sizeof...(Resources)> stamps;
+            std::tuple<TransactionValue<Resources>...> values(snapshot(resources, stamps[I])...);
+
+            auto unchanged = [&]() { return ((LockAccess::stamp(resources) == stamps[I]) && ...); };
+
+            // Only run func on a consistent cut of all resources.
+            if (!unchanged())
+            {
+                continue;
+            }
+
+            // The read-only resources are locked too, shared, so a writer
+            // still inside its critical section cannot slip past the stamps.
+            auto commit = [&]()
+            {
+                if constexpr ((!std::is_const<Resources>::value || ...))
+                {
+                    auto accessors = lockAll(resources...);
+                    if (!unchanged())
+                    {
+                        return false;
+                    }
+                    (commitValue<I>(std::get<I>(values), accessors), ...);
+                }
+                return true;
+            };
+
+            if constexpr (std::is_void<Result>::value)
+            {
+                std::invoke(func, std::get<I>(values)...);
+                if (commit())
+                {
+                    return;
+                }
+            }
+            else
+            {
+                Result result = std::invoke(func, std::get<I>(values)...);
+                if (commit())
+                {
+                    return result;
+                }
+            }
+        }
+
+        auto accessors = lockAll(resources...);
+        return std::invoke(func, *std::get<I>(accessors)...);
+    }
+}
+
+// Optimistic transaction over several resources. func gets a private copy of
+// each mutable resource and a read-only copy of each const one, taken without
+// holding any lock while it runs. On return the mutable resources are locked
+// exclusively and the const ones shared, and the copies are committed if no
+// resource changed meanwhile.
+// Otherwise func runs again on fresh copies; after a few failed attempts the
+// transaction falls back to running func under lockAll(). func may thus run
+// more than once and should have no side effects beyond the copies. Returns
+// what func returns.
+template<typename Func, typename ...Resources>
+auto transaction(Func func, Resources& ...resources)
+{
+    static_assert(sizeof...(Resources) > 0, "transaction() needs at least one resource");
+    return shared_resource_detail::transaction(func, std::index_sequence_for<Resources...>(), resources...);
+}
 
 #endif //SHARED_RESOURCE_H
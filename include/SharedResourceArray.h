@@ -0,0 +1,244 @@
+#ifndef SHARED_RESOURCE_ARRAY_H
+#define SHARED_RESOURCE_ARRAY_H
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "SharedResource.h"
+
+enum class ArrayLayout
+{
+    // Each element's mutex and data share a cache line padded block of their
+    // own, so threads on different elements never share a line.
+    Interleaved,
+
+    // All mutexes in one dense array and all data in another. Neighbouring
+    // locks share lines, but scans over the data touch no mutex bytes.
+    Split
+};
+
+// Fixed size array of independently locked elements, built with a single
+// allocation and no per-element heap use.
+template<typename T, typename Mutex = std::mutex, ArrayLayout Layout = ArrayLayout::Interleaved>
+class SharedResourceArray
+{
+    struct alignas(shared_resource_detail::cacheLineSize) Slot
+    {
+        template<typename ...Args>
+        Slot(const Args& ...args) : m_resource(args...) { }
+
+        SharedResource<T, Mutex> m_resource;
+    };
+
+    using ReadLock = typename std::conditional<shared_resource_detail::IsSharedMutex<Mutex>::value,
+                                               shared_resource_detail::ReadLock<Mutex>,
+                                               std::unique_lock<Mutex>>::type;
+
+    // Accessor of the split layout: a lock plus a pointer into the data array.
+    template<typename Lock, typename U>
+    class SplitAccessor
+    {
+        friend class SharedResourceArray;
+    public:
+        SplitAccessor(SplitAccessor&& a) noexcept :
+            m_lock(std::move(a.m_lock)),
+            m_value(std::exchange(a.m_value, nullptr)) { }
+
+        SplitAccessor& operator=(SplitAccessor&& a) noexcept
+        {
+            if (&a != this)
+            {
+                m_lock = std::move(a.m_lock);
+                m_value = std::exchange(a.m_value, nullptr);
+            }
+            return *this;
+        }
+
+        bool isValid() const noexcept
+        {
+            return m_value != nullptr;
+        }
+
+        U* operator->() const
+        {
+            return m_value;
+        }
+
+        U& operator*() const
+        {
+            return *m_value;
+        }
+
+    private:
+        SplitAccessor(Lock&& lock, U *value) :
+            m_lock(std::move(lock)),
+            m_value(m_lock.owns_lock() ? value : nullptr) { }
+
+        Lock    m_lock;
+        U       *m_value;
+    };
+
+    static constexpr bool split = Layout == ArrayLayout::Split;
+
+public:
+    using Accessor = typename std::conditional<split, SplitAccessor<std::unique_lock<Mutex>, T>,
+                                               typename SharedResource<T, Mutex>::Accessor>::type;
+    using ConstAccessor = typename std::conditional<split, SplitAccessor<ReadLock, const T>,
+                                                    typename SharedResource<T, Mutex>::ConstAccessor>::type;
+
+    // Every element is constructed from the same arguments.
+    template<typename ...Args>
+    explicit SharedResourceArray(std::size_t size, const Args& ...args) :
+        m_size(size),
+        m_storage(static_cast<std::byte*>(::operator new(storageSize(size), std::align_val_t(storageAlignment))))
+    {
+        std::size_t constructed = 0;
+        try
+        {
+            for (; constructed < size; ++constructed)
+            {
+                construct(constructed, args...);
+            }
+        }
+        catch (...)
+        {
+            destroy(constructed);
+            throw;
+        }
+    }
+
+    ~SharedResourceArray()
+    {
+        destroy(m_size);
+    }
+
+    SharedResourceArray(SharedResourceArray&&) = delete;
+    SharedResourceArray(const SharedResourceArray&) = delete;
+    SharedResourceArray& operator=(SharedResourceArray&&) = delete;
+    SharedResourceArray& operator=(const SharedResourceArray&) = delete;
+
+    std::size_t size() const noexcept
+    {
+        return m_size;
+    }
+
+    Accessor lock(std::size_t index)
+    {
+        if constexpr (split)
+        {
+            return Accessor(std::unique_lock<Mutex>(mutex(index)), &data(index));
+        }
+        else
+        {
+            return slot(index).m_resource.lock();
+        }
+    }
+
+    ConstAccessor lockConst(std::size_t index) const
+    {
+        if constexpr (split)
+        {
+            return ConstAccessor(ReadLock(mutex(index)), &data(index));
+        }
+        else
+        {
+            return slot(index).m_resource.lockConst();
+        }
+    }
+
+    Accessor tryLock(std::size_t index)
+    {
+        if constexpr (split)
+        {
+            return Accessor(std::unique_lock<Mutex>(mutex(index), std::try_to_lock), &data(index));
+        }
+        else
+        {
+            return slot(index).m_resource.tryLock();
+        }
+    }
+
+private:
+    static constexpr std::size_t storageAlignment = std::max(shared_resource_detail::cacheLineSize,
+                                                             std::max(alignof(T), alignof(Mutex)));
+
+    static constexpr std::size_t roundUp(std::size_t bytes) noexcept
+    {
+        return (bytes + storageAlignment - 1) / storageAlignment * storageAlignment;
+    }
+
+    static std::size_t storageSize(std::size_t size) noexcept
+    {
+        if constexpr (split)
+        {
+            return std::max<std::size_t>(roundUp(size * sizeof(Mutex)) + size * sizeof(T), 1);
+        }
+        else
+        {
+            return std::max<std::size_t>(size * sizeof(Slot), 1);
+        }
+    }
+
+    Slot& slot(std::size_t index) const noexcept
+    {
+        return reinterpret_cast<Slot*>(m_storage)[index];
+    }
+
+    Mutex& mutex(std::size_t index) const noexcept
+    {
+        return reinterpret_cast<Mutex*>(m_storage)[index];
+    }
+
+    T& data(std::size_t index) const noexcept
+    {
+        return reinterpret_cast<T*>(m_storage + roundUp(m_size * sizeof(Mutex)))[index];
+    }
+
+    template<typename ...Args>
+    void construct(std::size_t index, const Args& ...args)
+    {
+        if constexpr (split)
+        {
+            new (&mutex(index)) Mutex();
+            try
+            {
+                new (&data(index)) T(args...);
+            }
+            catch (...)
+            {
+                mutex(index).~Mutex();
+                throw;
+            }
+        }
+        else
+        {
+            new (&slot(index)) Slot(args...);
+        }
+    }
+
+    void destroy(std::size_t count) noexcept
+    {
+        for (std::size_t index = 0; index < count; ++index)
+        {
+            if constexpr (split)
+            {
+                mutex(index).~Mutex();
+                data(index).~T();
+            }
+            else
+            {
+                slot(index).~Slot();
+            }
+        }
+        ::operator delete(m_storage, std::align_val_t(storageAlignment));
+    }
+
+    const std::size_t   m_size;
+    std::byte           *m_storage;
+};
+
+#endif //SHARED_RESOURCE_ARRAY_H
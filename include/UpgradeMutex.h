@@ -0,0 +1,123 @@
+#ifndef UPGRADE_MUTEX_H
+#define UPGRADE_MUTEX_H
+
+#include <mutex>
+#include <shared_mutex>
+
+// Shared mutex with a third, upgradable ownership mode. An upgrade owner
+// coexists with shared owners but excludes writers and other upgrade owners,
+// so it can later turn into an exclusive owner without anyone else writing
+// in between. Exclusive owners can likewise downgrade to shared or upgrade
+// ownership without letting another writer in.
+//
+// Writers and upgrade owners serialize on a gate mutex first, and only then
+// take the inner shared_mutex. Holding the gate is what makes the transitions
+// atomic with respect to other writers.
+//
+// Used as the Mutex parameter of SharedResource it enables lockUpgradable()
+// and Accessor::downgrade().
+class UpgradeMutex
+{
+public:
+    UpgradeMutex() = default;
+    ~UpgradeMutex() = default;
+
+    UpgradeMutex(const UpgradeMutex&) = delete;
+    UpgradeMutex& operator=(const UpgradeMutex&) = delete;
+
+    void lock()
+    {
+        m_gate.lock();
+        m_shared.lock();
+    }
+
+    bool try_lock()
+    {
+        if (!m_gate.try_lock())
+        {
+            return false;
+        }
+
+        if (!m_shared.try_lock())
+        {
+            m_gate.unlock();
+            return false;
+        }
+        return true;
+    }
+
+    void unlock()
+    {
+        m_shared.unlock();
+        m_gate.unlock();
+    }
+
+    void lock_shared()
+    {
+        m_shared.lock_shared();
+    }
+
+    bool try_lock_shared()
+    {
+        return m_shared.try_lock_shared();
+    }
+
+    void unlock_shared()
+    {
+        m_shared.unlock_shared();
+    }
+
+    void lock_upgrade()
+    {
+        m_gate.lock();
+        m_shared.lock_shared();
+    }
+
+    bool try_lock_upgrade()
+    {
+        if (!m_gate.try_lock())
+        {
+            return false;
+        }
+
+        if (!m_shared.try_lock_shared())
+        {
+            m_gate.unlock();
+            return false;
+        }
+        return true;
+    }
+
+    void unlock_upgrade()
+    {
+        m_shared.unlock_shared();
+        m_gate.unlock();
+    }
+
+    // Waits for the remaining shared owners to leave. Readers may still come
+    // and go meanwhile, but no writer can get in while the gate is held.
+    void unlock_upgrade_and_lock()
+    {
+        m_shared.unlock_shared();
+        m_shared.lock();
+    }
+
+    void unlock_and_lock_upgrade()
+    {
+        m_shared.unlock();
+        m_shared.lock_shared();
+    }
+
+    void unlock_and_lock_shared()
+    {
+        m_shared.unlock();
+        m_shared.lock_shared();
+        m_gate.unlock();
+    }
+
+private:
+    std::mutex          m_gate;
+    std::shared_mutex   m_shared;
+};
+
+#endif //UPGRADE_MUTEX_H
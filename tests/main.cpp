@@ -1,11 +1,39 @@
 #include <thread>
 #include <chrono>
+#include <atomic>
 #include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
 
 #define BOOST_TEST_MAIN
 #include <boost/test/unit_test.hpp>
 
 #include "SharedResource.h"
+#include "ShardedSharedResource.h"
+#include "SharedFields.h"
+#include "SharedQueue.h"
+#include "SharedResourceArray.h"
+#include "InterprocessSharedResource.h"
+#include "RcuSharedResource.h"
+#include "LeftRightSharedResource.h"
+#include "AdaptiveMutex.h"
+#include "QueueMutex.h"
+#include "LockStats.h"
+#include "Combinable.h"
+#include "UpgradeMutex.h"
 
 
 BOOST_AUTO_TEST_CASE(Basic_construction)
@@ -464,6 +492,92 @@ BOOST_AUTO_TEST_CASE(SharedResource_with_recursive_mutex)
 }
 
 
+BOOST_AUTO_TEST_CASE(SharedResource_with_recursive_mutex_load)
+{
+    struct Pair
+    {
+        int m_first;
+        int m_second;
+    };
+    SharedResource<Pair, std::recursive_mutex> shared_pair(Pair{0, 0});
+
+    Pair seen{0, 0};
+    std::thread reader;
+    {
+        auto outer_accessor = shared_pair.lock();
+        {
+            auto inner_accessor = shared_pair.lock();
+            inner_accessor->m_first = 1;
+        }
+
+        // The outer write is still in progress, so load() has to wait for it.
+        reader = std::thread([&shared_pair, &seen]() { seen = shared_pair.load(); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        outer_accessor->m_second = 1;
+    }
+    reader.join();
+
+    BOOST_CHECK_EQUAL(1, seen.m_first);
+    BOOST_CHECK_EQUAL(1, seen.m_second);
+    BOOST_CHECK_EQUAL(1u, shared_pair.version());
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedResource_with_recursive_mutex_load_in_write)
+{
+    // The seqlock read gives up on the open write section and takes the
+    // lock, which the writing thread already holds.
+    SharedResource<int, std::recursive_mutex> shared_int(0);
+
+    auto shared_int_accessor = shared_int.lock();
+    *shared_int_accessor = 5;
+    BOOST_CHECK_EQUAL(5, shared_int.load());
+}
+
+
+BOOST_AUTO_TEST_CASE(Load_blocks_behind_writer)
+{
+    SharedResource<int> shared_int(0);
+    std::atomic<bool> started{false};
+    std::atomic<long> cpu_ns{0};
+    std::atomic<int> seen{0};
+    std::thread reader;
+
+    {
+        auto shared_int_accessor = shared_int.lock();
+        *shared_int_accessor = 1;
+        reader = std::thread([&shared_int, &started, &cpu_ns, &seen]()
+        {
+            timespec before{};
+            timespec after{};
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &before);
+            started = true;
+            seen = shared_int.load();
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &after);
+            cpu_ns = (after.tv_sec - before.tv_sec) * 1000000000L + (after.tv_nsec - before.tv_nsec);
+        });
+
+        while (!started)
+        {
+            std::this_thread::yield();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    reader.join();
+
+    BOOST_CHECK_EQUAL(1, seen.load());
+    BOOST_CHECK_LT(cpu_ns.load(), 50000000L);
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedResource_unused_features_are_free)
+{
+    // Everything beyond the version counter lives behind one pointer that
+    // is only allocated on first use.
+    BOOST_CHECK_LE(sizeof(SharedResource<int>), sizeof(int) + sizeof(std::mutex) + 4 * sizeof(void*));
+}
+
+
 BOOST_AUTO_TEST_CASE(SharedResource_with_recursive_mutex_condvar_any)
 {
     SharedResource<int, std::recursive_mutex> shared_int(42);
@@ -483,3 +597,2445 @@ BOOST_AUTO_TEST_CASE(SharedResource_with_recursive_mutex_condvar_any)
     BOOST_CHECK(wait_res);
 }
 
+
+
+BOOST_AUTO_TEST_CASE(SharedResource_with_shared_mutex)
+{
+    SharedResource<int, std::shared_mutex> shared_int(42);
+    auto shared_int_accessor = shared_int.lock();
+    BOOST_REQUIRE(shared_int_accessor.isValid());
+    *shared_int_accessor = 5;
+    BOOST_CHECK_EQUAL(5, *shared_int_accessor);
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedResource_with_shared_mutex_concurrent_readers)
+{
+    SharedResource<int, std::shared_mutex> shared_int(42);
+    std::atomic<bool> reader_done(false);
+
+    auto shared_int_accessor = shared_int.lockConst();
+
+    std::thread test_thread([&shared_int, &reader_done]()
+    {
+        auto shared_int_accessor = shared_int.lockConst();
+        BOOST_CHECK_EQUAL(42, *shared_int_accessor);
+        reader_done = true;
+    });
+
+    for (int i = 0; i < 100 && !reader_done; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    BOOST_CHECK(reader_done);
+    BOOST_CHECK_EQUAL(42, *shared_int_accessor);
+    test_thread.join();
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedResource_with_shared_mutex_writer_excludes_readers)
+{
+    SharedResource<int, std::shared_mutex> shared_int(0);
+
+    std::thread test_thread;
+    {
+        auto shared_int_accessor = shared_int.lock();
+
+        test_thread = std::thread([&shared_int]()
+        {
+            auto shared_int_accessor = shared_int.lockConst();
+            BOOST_CHECK_EQUAL(7, *shared_int_accessor);
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        *shared_int_accessor = 7;
+    }
+    test_thread.join();
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedResource_with_shared_mutex_ConstAccessor_from_Accessor)
+{
+    SharedResource<int, std::shared_mutex> shared_int(42);
+
+    auto shared_int_accessor = shared_int.lock();
+    SharedResource<int, std::shared_mutex>::ConstAccessor shared_int_const_accessor(std::move(shared_int_accessor));
+    BOOST_CHECK(!shared_int_accessor.isValid());
+    BOOST_REQUIRE(shared_int_const_accessor.isValid());
+    BOOST_CHECK_EQUAL(42, *shared_int_const_accessor);
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedResource_with_shared_mutex_condvar_any)
+{
+    SharedResource<int, std::shared_mutex> shared_int(42);
+    std::condition_variable_any condvar;
+
+    auto shared_int_accessor = shared_int.lockConst();
+    auto wait_res = shared_int_accessor.waitFor(condvar, std::chrono::milliseconds(50), []{ return false; });
+    BOOST_CHECK(!wait_res);
+    wait_res = shared_int_accessor.waitFor(condvar, std::chrono::milliseconds(50), []{ return true; });
+    BOOST_CHECK(wait_res);
+
+    wait_res = shared_int_accessor.waitUntil(condvar, std::chrono::steady_clock::now() +
+                                                      std::chrono::milliseconds(50), [] { return false; });
+    BOOST_CHECK(!wait_res);
+    wait_res = shared_int_accessor.waitUntil(condvar, std::chrono::steady_clock::now() +
+                                                      std::chrono::milliseconds(50), [] { return true; });
+    BOOST_CHECK(wait_res);
+}
+
+
+BOOST_AUTO_TEST_CASE(TryLock_basic)
+{
+    SharedResource<int> shared_int(42);
+    auto shared_int_accessor = shared_int.tryLock();
+    BOOST_REQUIRE(shared_int_accessor.isValid());
+    BOOST_CHECK_EQUAL(42, *shared_int_accessor);
+}
+
+
+BOOST_AUTO_TEST_CASE(TryLock_fails_when_locked)
+{
+    SharedResource<int> shared_int(42);
+    auto shared_int_accessor = shared_int.lock();
+
+    std::thread test_thread([&shared_int]()
+    {
+        auto shared_int_accessor = shared_int.tryLock();
+        BOOST_CHECK(!shared_int_accessor.isValid());
+        auto shared_int_const_accessor = shared_int.tryLockConst();
+        BOOST_CHECK(!shared_int_const_accessor.isValid());
+    });
+    test_thread.join();
+}
+
+
+BOOST_AUTO_TEST_CASE(TryLockFor_timed_mutex)
+{
+    SharedResource<int, std::timed_mutex> shared_int(42);
+    auto shared_int_accessor = shared_int.lock();
+
+    std::thread test_thread([&shared_int]()
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto shared_int_accessor = shared_int.tryLockFor(std::chrono::milliseconds(50));
+        BOOST_CHECK(!shared_int_accessor.isValid());
+        BOOST_CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(50));
+
+        auto shared_int_const_accessor = shared_int.tryLockConstUntil(std::chrono::steady_clock::now() +
+                                                                      std::chrono::milliseconds(50));
+        BOOST_CHECK(!shared_int_const_accessor.isValid());
+    });
+    test_thread.join();
+}
+
+
+BOOST_AUTO_TEST_CASE(TryLockUntil_succeeds_after_release)
+{
+    SharedResource<int, std::timed_mutex> shared_int(0);
+
+    std::thread test_thread;
+    {
+        auto shared_int_accessor = shared_int.lock();
+
+        test_thread = std::thread([&shared_int]()
+        {
+            auto shared_int_accessor = shared_int.tryLockUntil(std::chrono::steady_clock::now() +
+                                                               std::chrono::seconds(10));
+            BOOST_CHECK(shared_int_accessor.isValid());
+            if (shared_int_accessor.isValid())
+            {
+                BOOST_CHECK_EQUAL(7, *shared_int_accessor);
+            }
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        *shared_int_accessor = 7;
+    }
+    test_thread.join();
+}
+
+
+BOOST_AUTO_TEST_CASE(TryLockConst_shared_timed_mutex)
+{
+    SharedResource<int, std::shared_timed_mutex> shared_int(42);
+    auto shared_int_const_accessor = shared_int.lockConst();
+
+    std::thread test_thread([&shared_int]()
+    {
+        auto shared_int_const_accessor = shared_int.tryLockConstFor(std::chrono::milliseconds(50));
+        BOOST_CHECK(shared_int_const_accessor.isValid());
+
+        auto shared_int_accessor = shared_int.tryLockFor(std::chrono::milliseconds(50));
+        BOOST_CHECK(!shared_int_accessor.isValid());
+    });
+    test_thread.join();
+}
+
+#if defined(__cpp_lib_jthread)
+BOOST_AUTO_TEST_CASE(TryLockUntil_stop_token)
+{
+    SharedResource<int, std::timed_mutex> shared_int(42);
+    auto shared_int_accessor = shared_int.lock();
+    std::stop_source stop;
+
+    std::thread test_thread([&shared_int, &stop]()
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto shared_int_accessor = shared_int.tryLockFor(std::chrono::seconds(10), stop.get_token());
+        BOOST_CHECK(!shared_int_accessor.isValid());
+        BOOST_CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+
+        auto shared_int_const_accessor = shared_int.tryLockConstUntil(std::chrono::steady_clock::now() +
+                                                                      std::chrono::seconds(10), stop.get_token());
+        BOOST_CHECK(!shared_int_const_accessor.isValid());
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    stop.request_stop();
+    test_thread.join();
+}
+#endif
+
+
+BOOST_AUTO_TEST_CASE(LockAll_basic)
+{
+    SharedResource<int> shared_int_1(1);
+    SharedResource<int> shared_int_2(2);
+    const SharedResource<int, std::shared_mutex> shared_int_3(3);
+
+    auto [accessor_1, accessor_2, accessor_3] = lockAll(shared_int_1, shared_int_2, shared_int_3);
+    BOOST_REQUIRE(accessor_1.isValid());
+    BOOST_REQUIRE(accessor_2.isValid());
+    BOOST_REQUIRE(accessor_3.isValid());
+    *accessor_1 = *accessor_2 + *accessor_3;
+    BOOST_CHECK_EQUAL(5, *accessor_1);
+}
+
+
+BOOST_AUTO_TEST_CASE(LockAll_single)
+{
+    SharedResource<int> shared_int(42);
+    auto [shared_int_accessor] = lockAll(shared_int);
+    BOOST_REQUIRE(shared_int_accessor.isValid());
+    BOOST_CHECK_EQUAL(42, *shared_int_accessor);
+}
+
+
+BOOST_AUTO_TEST_CASE(LockAll_no_deadlock)
+{
+    SharedResource<int> shared_int_1(0);
+    SharedResource<int> shared_int_2(0);
+
+    auto worker = [](SharedResource<int>& first, SharedResource<int>& second)
+    {
+        for (int i = 0; i < 10000; ++i)
+        {
+            auto [first_accessor, second_accessor] = lockAll(first, second);
+            ++*first_accessor;
+            ++*second_accessor;
+        }
+    };
+
+    std::thread test_thread_1(worker, std::ref(shared_int_1), std::ref(shared_int_2));
+    std::thread test_thread_2(worker, std::ref(shared_int_2), std::ref(shared_int_1));
+    test_thread_1.join();
+    test_thread_2.join();
+
+    BOOST_CHECK_EQUAL(20000, *shared_int_1.lockConst());
+    BOOST_CHECK_EQUAL(20000, *shared_int_2.lockConst());
+}
+
+
+BOOST_AUTO_TEST_CASE(TryLockAll_all_or_nothing)
+{
+    SharedResource<int> shared_int_1(1);
+    SharedResource<int> shared_int_2(2);
+
+    auto shared_int_2_accessor = shared_int_2.lock();
+
+    std::thread test_thread([&shared_int_1, &shared_int_2]()
+    {
+        auto [accessor_1, accessor_2] = tryLockAll(shared_int_1, shared_int_2);
+        BOOST_CHECK(!accessor_1.isValid());
+        BOOST_CHECK(!accessor_2.isValid());
+        BOOST_CHECK(shared_int_1.tryLock().isValid());
+    });
+    test_thread.join();
+}
+
+
+BOOST_AUTO_TEST_CASE(TryLockAllFor_deadline)
+{
+    SharedResource<int, std::timed_mutex> shared_int_1(1);
+    const SharedResource<int, std::shared_timed_mutex> shared_int_2(2);
+
+    {
+        auto [accessor_1, accessor_2] = tryLockAllFor(std::chrono::milliseconds(50), shared_int_1, shared_int_2);
+        BOOST_REQUIRE(accessor_1.isValid());
+        BOOST_REQUIRE(accessor_2.isValid());
+        BOOST_CHECK_EQUAL(3, *accessor_1 + *accessor_2);
+    }
+
+    auto shared_int_1_accessor = shared_int_1.lock();
+
+    std::thread test_thread([&shared_int_1, &shared_int_2]()
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto [accessor_2, accessor_1] = tryLockAllUntil(start + std::chrono::milliseconds(50), shared_int_2, shared_int_1);
+        BOOST_CHECK(!accessor_1.isValid());
+        BOOST_CHECK(!accessor_2.isValid());
+        BOOST_CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(50));
+        BOOST_CHECK(shared_int_2.tryLockConst().isValid());
+    });
+    test_thread.join();
+}
+
+
+BOOST_AUTO_TEST_CASE(Transaction_commits_copies)
+{
+    SharedResource<int> from(100);
+    SharedResource<int> to(0);
+    const SharedResource<int, std::shared_mutex> rate(2);
+
+    auto moved = transaction([](int& from_value, int& to_value, const int& rate_value)
+    {
+        const int amount = 10 * rate_value;
+        from_value -= amount;
+        to_value += amount;
+        return amount;
+    }, from, to, rate);
+
+    BOOST_CHECK_EQUAL(20, moved);
+    BOOST_CHECK_EQUAL(80, from.load());
+    BOOST_CHECK_EQUAL(20, to.load());
+
+    const auto& const_from = from;
+    BOOST_CHECK_EQUAL(100, transaction([](const int& a, const int& b) { return a + b; }, const_from, std::as_const(to)));
+}
+
+
+BOOST_AUTO_TEST_CASE(Transaction_retries_on_conflict)
+{
+    SharedResource<int> shared_int(1);
+    SharedResource<int> shared_sum(0);
+
+    int calls = 0;
+    transaction([&](const int& value, int& sum)
+    {
+        if (calls++ == 0)
+        {
+            *shared_int.lock() = 2;
+        }
+        sum = value * 10;
+    }, std::as_const(shared_int), shared_sum);
+
+    BOOST_CHECK_EQUAL(2, calls);
+    BOOST_CHECK_EQUAL(20, shared_sum.load());
+}
+
+
+BOOST_AUTO_TEST_CASE(Transaction_concurrent_transfers)
+{
+    std::vector<SharedResource<long>> accounts(3);
+    for (auto& account : accounts)
+    {
+        *account.lock() = 1000;
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 3; ++i)
+    {
+        threads.emplace_back([&accounts, i]()
+        {
+            for (int j = 0; j < 2000; ++j)
+            {
+                transaction([](long& from, long& to) { --from; ++to; }, accounts[i], accounts[(i + 1) % 3]);
+            }
+        });
+    }
+    threads.emplace_back([&accounts]()
+    {
+        for (int j = 0; j < 2000; ++j)
+        {
+            accounts[0].defer([](long& value) { ++value; });
+        }
+    });
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    long total = 0;
+    for (auto& account : accounts)
+    {
+        total += account.load();
+    }
+    BOOST_CHECK_EQUAL(3 * 1000 + 2000, total);
+}
+
+
+namespace
+{
+    std::atomic<int> committing{0};
+
+    // Lets a commit wait briefly for another one, which lines up two
+    // transactions that have both passed validation.
+    struct OnCall
+    {
+        OnCall(int count) : count(count) { }
+        OnCall(const OnCall&) = default;
+
+        OnCall& operator=(OnCall&& other)
+        {
+            ++committing;
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+            while (committing < 2 && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::yield();
+            }
+            count = other.count;
+            return *this;
+        }
+
+        int count;
+    };
+}
+
+
+BOOST_AUTO_TEST_CASE(Transaction_crossing_reads_and_writes)
+{
+    // Each transaction writes one resource and only reads the other, and
+    // may go off call only while both are on it.
+    SharedResource<OnCall> alice(1);
+    SharedResource<OnCall> bob(1);
+    std::atomic<int> running{0};
+
+    auto leave = [&running](OnCall& self, const OnCall& other)
+    {
+        ++running;
+        while (running < 2)
+        {
+            std::this_thread::yield();
+        }
+        if (self.count + other.count >= 2)
+        {
+            --self.count;
+        }
+    };
+
+    committing = 0;
+    std::thread test_thread([&]() { transaction(leave, alice, std::as_const(bob)); });
+    transaction(leave, bob, std::as_const(alice));
+    test_thread.join();
+
+    BOOST_CHECK_EQUAL(1, alice.load().count + bob.load().count);
+}
+
+
+BOOST_AUTO_TEST_CASE(ShardedSharedResource_basic)
+{
+    ShardedSharedResource<std::unordered_map<int, std::string>, 8> shared_map(64);
+
+    for (int i = 0; i < 100; ++i)
+    {
+        shared_map.lock(i)->emplace(i, std::to_string(i));
+    }
+
+    for (int i = 0; i < 100; ++i)
+    {
+        auto shard_accessor = shared_map.lockConst(i);
+        auto it = shard_accessor->find(i);
+        BOOST_REQUIRE(it != shard_accessor->end());
+        BOOST_CHECK_EQUAL(std::to_string(i), it->second);
+    }
+
+    std::size_t total = 0;
+    std::size_t non_empty_shards = 0;
+    shared_map.forEachShard([&](const std::unordered_map<int, std::string>& shard)
+    {
+        total += shard.size();
+        non_empty_shards += shard.empty() ? 0 : 1;
+    });
+    BOOST_CHECK_EQUAL(100u, total);
+    BOOST_CHECK(non_empty_shards > 1);
+}
+
+
+BOOST_AUTO_TEST_CASE(ShardedSharedResource_independent_shards)
+{
+    ShardedSharedResource<std::unordered_map<int, int>, 4, std::shared_mutex> shared_map;
+
+    int other_key = 1;
+    while (shared_map.shardIndex(other_key) == shared_map.shardIndex(0))
+    {
+        ++other_key;
+    }
+
+    auto shard_accessor = shared_map.lock(0);
+
+    std::thread test_thread([&shared_map, other_key]()
+    {
+        shared_map.lock(other_key)->emplace(other_key, 1);
+    });
+    test_thread.join();
+
+    BOOST_CHECK_EQUAL(1u, shared_map.lockConst(other_key)->count(other_key));
+}
+
+
+BOOST_AUTO_TEST_CASE(ShardedSharedResource_concurrent_updates)
+{
+    ShardedSharedResource<std::unordered_map<int, int>, 16> shared_map;
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&shared_map]()
+        {
+            for (int i = 0; i < 1000; ++i)
+            {
+                ++(*shared_map.lock(i % 64))[i % 64];
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    int total = 0;
+    shared_map.forEachShard([&total](std::unordered_map<int, int>& shard)
+    {
+        for (auto& item : shard)
+        {
+            total += item.second;
+        }
+    });
+    BOOST_CHECK_EQUAL(4000, total);
+}
+
+
+BOOST_AUTO_TEST_CASE(RcuSharedResource_basic)
+{
+    RcuSharedResource<std::vector<int>> shared_vector(3, 7);
+
+    auto snapshot = shared_vector.snapshot();
+    BOOST_REQUIRE(snapshot);
+    BOOST_CHECK_EQUAL(3u, snapshot->size());
+
+    {
+        auto shared_vector_accessor = shared_vector.lock();
+        BOOST_REQUIRE(shared_vector_accessor.isValid());
+        shared_vector_accessor->push_back(42);
+        BOOST_CHECK_EQUAL(3u, shared_vector.snapshot()->size());
+    }
+
+    BOOST_CHECK_EQUAL(3u, snapshot->size());
+    BOOST_CHECK_EQUAL(4u, shared_vector.snapshot()->size());
+    BOOST_CHECK_EQUAL(42, shared_vector.snapshot()->back());
+}
+
+
+BOOST_AUTO_TEST_CASE(RcuSharedResource_readers_do_not_block)
+{
+    RcuSharedResource<int> shared_int(42);
+
+    {
+        auto shared_int_accessor = shared_int.lock();
+        *shared_int_accessor = 7;
+
+        std::thread test_thread([&shared_int]()
+        {
+            BOOST_CHECK_EQUAL(42, *shared_int.snapshot());
+        });
+        test_thread.join();
+
+        auto shared_int_accessor_2(std::move(shared_int_accessor));
+        BOOST_CHECK(!shared_int_accessor.isValid());
+        BOOST_CHECK_EQUAL(42, *shared_int.snapshot());
+    }
+
+    BOOST_CHECK_EQUAL(7, *shared_int.snapshot());
+}
+
+
+BOOST_AUTO_TEST_CASE(RcuSharedResource_concurrent_writers)
+{
+    RcuSharedResource<int> shared_int(0);
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&shared_int]()
+        {
+            for (int i = 0; i < 1000; ++i)
+            {
+                auto shared_int_accessor = shared_int.lock();
+                ++*shared_int_accessor;
+                BOOST_CHECK(*shared_int.snapshot() >= 0);
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    BOOST_CHECK_EQUAL(4000, *shared_int.snapshot());
+}
+
+
+BOOST_AUTO_TEST_CASE(Load_basic)
+{
+    SharedResource<int> shared_int(42);
+    BOOST_CHECK_EQUAL(42, shared_int.load());
+
+    *shared_int.lock() = 7;
+    BOOST_CHECK_EQUAL(7, shared_int.load());
+
+    SharedResource<std::string> shared_string("test");
+    BOOST_CHECK_EQUAL("test", shared_string.load());
+}
+
+
+BOOST_AUTO_TEST_CASE(Load_seqlock_consistency)
+{
+    struct Tick
+    {
+        long long price;
+        long long volume;
+        long long checksum;
+    };
+
+    SharedResource<Tick> shared_tick(Tick{0, 0, 0});
+    std::atomic<bool> stop(false);
+
+    std::thread writer([&shared_tick, &stop]()
+    {
+        for (long long i = 1; !stop; ++i)
+        {
+            auto tick_accessor = shared_tick.lock();
+            tick_accessor->price = i;
+            tick_accessor->volume = i * 2;
+            tick_accessor->checksum = i * 3;
+        }
+    });
+
+    for (int i = 0; i < 100000; ++i)
+    {
+        Tick tick = shared_tick.load();
+        BOOST_REQUIRE_EQUAL(tick.price * 2, tick.volume);
+        BOOST_REQUIRE_EQUAL(tick.price * 3, tick.checksum);
+    }
+
+    stop = true;
+    writer.join();
+}
+
+
+BOOST_AUTO_TEST_CASE(Load_while_writer_waits_on_condvar)
+{
+    SharedResource<int> shared_int(0);
+    std::condition_variable condvar;
+
+    std::thread test_thread([&shared_int, &condvar]()
+    {
+        auto shared_int_accessor = shared_int.lock();
+        *shared_int_accessor = 7;
+        shared_int_accessor.waitFor(condvar, std::chrono::milliseconds(500));
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto start = std::chrono::steady_clock::now();
+    BOOST_CHECK_EQUAL(7, shared_int.load());
+    BOOST_CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(250));
+
+    test_thread.join();
+}
+
+
+BOOST_AUTO_TEST_CASE(AdaptiveMutex_basic)
+{
+    AdaptiveMutex mutex;
+    BOOST_CHECK(mutex.try_lock());
+    BOOST_CHECK(!mutex.try_lock());
+    mutex.unlock();
+
+    mutex.lock();
+    mutex.unlock();
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedResource_with_AdaptiveMutex)
+{
+    SharedResource<long long, AdaptiveMutex> shared_counter(0);
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < 8; ++t)
+    {
+        threads.emplace_back([&shared_counter]()
+        {
+            for (int i = 0; i < 20000; ++i)
+            {
+                ++*shared_counter.lock();
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    BOOST_CHECK_EQUAL(160000, *shared_counter.lockConst());
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedResource_with_AdaptiveMutex_long_hold)
+{
+    SharedResource<int, AdaptiveMutex> shared_int(0);
+
+    std::thread test_thread;
+    {
+        auto shared_int_accessor = shared_int.lock();
+
+        test_thread = std::thread([&shared_int]()
+        {
+            BOOST_CHECK_EQUAL(7, *shared_int.lockConst());
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        *shared_int_accessor = 7;
+    }
+    test_thread.join();
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedResource_with_AdaptiveMutex_condvar_any)
+{
+    SharedResource<int, AdaptiveMutex> shared_int(0);
+    std::condition_variable_any condvar;
+
+    std::thread test_thread([&shared_int, &condvar]()
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        *shared_int.lock() = 7;
+        condvar.notify_all();
+    });
+
+    auto shared_int_accessor = shared_int.lock();
+    bool wait_res = shared_int_accessor.waitFor(condvar, std::chrono::seconds(10),
+                                                [&shared_int_accessor] { return *shared_int_accessor == 7; });
+    BOOST_CHECK(wait_res);
+    test_thread.join();
+}
+
+
+BOOST_AUTO_TEST_CASE(NoInstrumentation_is_free)
+{
+    static_assert(std::is_empty<NoInstrumentation>::value, "NoInstrumentation must not add state");
+    BOOST_CHECK_LT(sizeof(SharedResource<std::string>),
+                   sizeof(SharedResource<std::string, std::mutex, LockStats>));
+    BOOST_CHECK_EQUAL(sizeof(SharedResource<std::string>::Accessor),
+                      sizeof(std::unique_lock<std::mutex>) + 2 * sizeof(void*));
+}
+
+
+BOOST_AUTO_TEST_CASE(LockStats_counts_acquisitions)
+{
+    SharedResource<int, std::shared_mutex, LockStats> shared_int(0);
+    shared_int.setName("counter");
+
+    *shared_int.lock() = 1;
+    BOOST_CHECK_EQUAL(1, *shared_int.lockConst());
+
+    std::thread test_thread;
+    {
+        auto shared_int_accessor = shared_int.lock();
+        test_thread = std::thread([&shared_int]()
+        {
+            BOOST_CHECK_EQUAL(2, *shared_int.lockConst());
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        *shared_int_accessor = 2;
+    }
+    test_thread.join();
+
+    std::ostringstream out;
+    LockStatsRegistry::instance().dump(out);
+    const std::string json = out.str();
+
+    BOOST_CHECK(json.find("\"name\":\"counter\"") != std::string::npos);
+    BOOST_CHECK(json.find("\"acquisitions\":4,\"contended\":1") != std::string::npos);
+    BOOST_CHECK(json.find("\"hold_ns\":{\"count\":4,") != std::string::npos);
+}
+
+
+BOOST_AUTO_TEST_CASE(LockStats_hold_time_survives_moves)
+{
+    SharedResource<int, std::mutex, LockStats> shared_int(0);
+    shared_int.setName("moved");
+
+    {
+        auto shared_int_accessor = shared_int.lock();
+        auto moved_accessor = std::move(shared_int_accessor);
+        shared_int_accessor = std::move(moved_accessor);
+    }
+    {
+        auto [shared_int_accessor] = lockAll(shared_int);
+        auto mapped_accessor = shared_int_accessor.map([](int& value) -> int& { return value; });
+    }
+
+    std::ostringstream out;
+    LockStatsRegistry::instance().dump(out);
+    const std::string json = out.str();
+
+    const auto hold = json.find("\"hold_ns\":{\"count\":", json.find("\"name\":\"moved\""));
+    BOOST_REQUIRE(hold != std::string::npos);
+    std::istringstream in(json.substr(hold + std::strlen("\"hold_ns\":{\"count\":")));
+    std::uint64_t count = 0;
+    std::uint64_t sum = 0;
+    in >> count;
+    in.ignore(std::strlen(",\"sum\":"));
+    in >> sum;
+
+    BOOST_CHECK_EQUAL(2u, count);
+    BOOST_CHECK_LT(sum, 1000000000u);
+}
+
+
+BOOST_AUTO_TEST_CASE(LockStats_registry_tracks_lifetime)
+{
+    auto count_resources = []()
+    {
+        std::ostringstream out;
+        LockStatsRegistry::instance().dump(out);
+        const std::string json = out.str();
+
+        std::size_t count = 0;
+        for (auto pos = json.find("\"name\""); pos != std::string::npos; pos = json.find("\"name\"", pos + 1))
+        {
+            ++count;
+        }
+        return count;
+    };
+
+    const std::size_t before = count_resources();
+    {
+        SharedResource<int, std::mutex, LockStats> shared_int(0);
+        BOOST_CHECK_EQUAL(before + 1, count_resources());
+    }
+    BOOST_CHECK_EQUAL(before, count_resources());
+}
+
+
+BOOST_AUTO_TEST_CASE(Apply_basic)
+{
+    SharedResource<std::vector<int>> shared_vector;
+
+    shared_vector.apply([](std::vector<int>& vector) { vector.push_back(42); });
+    auto size = shared_vector.apply([](std::vector<int>& vector) { return vector.size(); });
+    BOOST_CHECK_EQUAL(1u, size);
+
+    auto front = shared_vector.applyConst([](const std::vector<int>& vector) { return vector.front(); });
+    BOOST_CHECK_EQUAL(42, front);
+}
+
+
+BOOST_AUTO_TEST_CASE(Apply_exception)
+{
+    SharedResource<int> shared_int(42);
+
+    BOOST_CHECK_THROW(shared_int.apply([](int&) -> int { throw std::runtime_error("test"); }), std::runtime_error);
+    BOOST_CHECK_EQUAL(42, shared_int.applyConst([](const int& value) { return value; }));
+}
+
+
+BOOST_AUTO_TEST_CASE(Apply_concurrent)
+{
+    SharedResource<long long> shared_counter(0);
+    std::vector<std::thread> threads;
+    std::atomic<long long> returned_sum(0);
+
+    for (int t = 0; t < 8; ++t)
+    {
+        threads.emplace_back([&shared_counter, &returned_sum]()
+        {
+            long long sum = 0;
+            for (int i = 0; i < 10000; ++i)
+            {
+                sum += shared_counter.apply([](long long& counter) { return ++counter; });
+            }
+            returned_sum += sum;
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    const long long total = 80000;
+    BOOST_CHECK_EQUAL(total, shared_counter.load());
+    BOOST_CHECK_EQUAL(total * (total + 1) / 2, returned_sum.load());
+}
+
+
+BOOST_AUTO_TEST_CASE(Apply_mixed_with_lock)
+{
+    SharedResource<int, std::shared_mutex> shared_int(0);
+
+    std::thread test_thread([&shared_int]()
+    {
+        for (int i = 0; i < 10000; ++i)
+        {
+            shared_int.apply([](int& value) { ++value; });
+        }
+    });
+
+    for (int i = 0; i < 10000; ++i)
+    {
+        ++*shared_int.lock();
+    }
+    test_thread.join();
+
+    BOOST_CHECK_EQUAL(20000, *shared_int.lockConst());
+}
+
+
+BOOST_AUTO_TEST_CASE(Apply_blocks_behind_long_hold)
+{
+    SharedResource<int> shared_int(0);
+    std::atomic<bool> started{false};
+    std::atomic<long> cpu_ns{0};
+    std::thread test_thread;
+
+    {
+        auto accessor = shared_int.lock();
+        test_thread = std::thread([&shared_int, &started, &cpu_ns]()
+        {
+            timespec before{};
+            timespec after{};
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &before);
+            started = true;
+            shared_int.apply([](int& value) { ++value; });
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &after);
+            cpu_ns = (after.tv_sec - before.tv_sec) * 1000000000L + (after.tv_nsec - before.tv_nsec);
+        });
+
+        while (!started)
+        {
+            std::this_thread::yield();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    test_thread.join();
+
+    // Spinning through the whole hold would have taken about 200ms of CPU.
+    BOOST_CHECK_EQUAL(1, shared_int.load());
+    BOOST_CHECK_LT(cpu_ns.load(), 50000000L);
+}
+
+#if defined(SHARED_RESOURCE_HAS_COROUTINES)
+namespace
+{
+    struct DetachedTask
+    {
+        struct promise_type
+        {
+            DetachedTask get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() { }
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    DetachedTask appendAsync(SharedResource<std::vector<int>>& shared_vector, int value)
+    {
+        auto shared_vector_accessor = co_await shared_vector.lockAsync();
+        shared_vector_accessor->push_back(value);
+    }
+
+    template<typename Schedule>
+    DetachedTask appendAsync(SharedResource<std::vector<int>>& shared_vector, int value, Schedule schedule)
+    {
+        auto shared_vector_accessor = co_await shared_vector.lockAsync(schedule);
+        shared_vector_accessor->push_back(value);
+    }
+
+    DetachedTask readAsync(const SharedResource<int, std::shared_mutex>& shared_int, std::atomic<int>& sum)
+    {
+        auto shared_int_accessor = co_await shared_int.lockConstAsync();
+        sum += *shared_int_accessor;
+    }
+
+    DetachedTask writeAsync(SharedResource<int, std::shared_mutex>& shared_int, int value)
+    {
+        auto shared_int_accessor = co_await shared_int.lockAsync();
+        *shared_int_accessor = value;
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(LockAsync_uncontended)
+{
+    SharedResource<std::vector<int>> shared_vector;
+    appendAsync(shared_vector, 42);
+    BOOST_REQUIRE_EQUAL(1u, shared_vector.lockConst()->size());
+    BOOST_CHECK_EQUAL(42, shared_vector.lockConst()->front());
+}
+
+
+BOOST_AUTO_TEST_CASE(LockAsync_fifo_resume_on_release)
+{
+    SharedResource<std::vector<int>> shared_vector;
+
+    {
+        auto shared_vector_accessor = shared_vector.lock();
+        appendAsync(shared_vector, 1);
+        appendAsync(shared_vector, 2);
+        appendAsync(shared_vector, 3);
+        BOOST_CHECK(shared_vector_accessor->empty());
+    }
+
+    BOOST_CHECK((std::vector<int>{1, 2, 3}) == *shared_vector.lockConst());
+}
+
+
+BOOST_AUTO_TEST_CASE(LockAsync_long_queue)
+{
+    // Each release resumes the next waiter, which must not nest on the stack.
+    SharedResource<std::vector<int>> shared_vector;
+    {
+        auto shared_vector_accessor = shared_vector.lock();
+        for (int i = 0; i < 100000; ++i)
+        {
+            appendAsync(shared_vector, i);
+        }
+    }
+
+    BOOST_CHECK_EQUAL(100000u, shared_vector.lockConst()->size());
+}
+
+
+BOOST_AUTO_TEST_CASE(LockAsync_custom_schedule)
+{
+    SharedResource<std::vector<int>> shared_vector;
+    std::vector<std::coroutine_handle<>> executor;
+    auto schedule = [&executor](std::coroutine_handle<> handle) { executor.push_back(handle); };
+
+    {
+        auto shared_vector_accessor = shared_vector.lock();
+        appendAsync(shared_vector, 7, schedule);
+    }
+
+    // The woken coroutine only takes the lock once the executor runs it.
+    BOOST_REQUIRE_EQUAL(1u, executor.size());
+    std::thread([&shared_vector]() { BOOST_CHECK(shared_vector.tryLock().isValid()); }).join();
+
+    executor.front().resume();
+    BOOST_CHECK((std::vector<int>{7}) == *shared_vector.lockConst());
+
+    {
+        auto shared_vector_accessor = shared_vector.lock();
+        appendAsync(shared_vector, 8, schedule);
+    }
+    BOOST_REQUIRE_EQUAL(2u, executor.size());
+
+    // If another thread got the lock meanwhile, it queues up again and is
+    // woken by that thread's release.
+    std::atomic<bool> locked{false};
+    std::atomic<bool> resumed{false};
+    std::thread holder([&]()
+    {
+        auto shared_vector_accessor = shared_vector.lock();
+        locked = true;
+        while (!resumed)
+        {
+            std::this_thread::yield();
+        }
+    });
+    while (!locked)
+    {
+        std::this_thread::yield();
+    }
+    executor.back().resume();
+    resumed = true;
+    holder.join();
+
+    BOOST_REQUIRE_EQUAL(3u, executor.size());
+    executor.back().resume();
+    BOOST_CHECK((std::vector<int>{7, 8}) == *shared_vector.lockConst());
+}
+
+
+BOOST_AUTO_TEST_CASE(LockConstAsync_wakes_all_readers)
+{
+    SharedResource<int, std::shared_mutex> shared_int(0);
+    std::atomic<int> sum(0);
+
+    {
+        auto shared_int_accessor = shared_int.lock();
+        readAsync(shared_int, sum);
+        readAsync(shared_int, sum);
+        *shared_int_accessor = 5;
+    }
+
+    BOOST_CHECK_EQUAL(10, sum.load());
+}
+
+
+BOOST_AUTO_TEST_CASE(LockConstAsync_merges_deferred)
+{
+    SharedResource<int, std::shared_mutex> shared_int(0);
+    std::atomic<int> sum(0);
+
+    shared_int.defer([](int& value) { ++value; });
+    readAsync(shared_int, sum);
+    BOOST_CHECK_EQUAL(1, sum.load());
+
+    {
+        auto shared_int_accessor = shared_int.lock();
+        shared_int.defer([](int& value) { ++value; });
+        readAsync(shared_int, sum);
+    }
+    BOOST_CHECK_EQUAL(3, sum.load());
+}
+
+
+BOOST_AUTO_TEST_CASE(LockAsync_stays_queued_while_readers_remain)
+{
+    SharedResource<int, std::shared_mutex> shared_int(0);
+
+    {
+        auto first_reader = shared_int.lockConst();
+        {
+            auto second_reader = shared_int.lockConst();
+            writeAsync(shared_int, 5);
+        }
+
+        // Releasing the second reader must neither block nor let the writer in.
+        BOOST_CHECK_EQUAL(0, *first_reader);
+    }
+
+    BOOST_CHECK_EQUAL(5, shared_int.load());
+}
+
+
+BOOST_AUTO_TEST_CASE(LockAsync_threads)
+{
+    SharedResource<std::vector<int>> shared_vector;
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&shared_vector, t]()
+        {
+            for (int i = 0; i < 1000; ++i)
+            {
+                if (i % 2)
+                {
+                    appendAsync(shared_vector, t);
+                }
+                else
+                {
+                    shared_vector.lock()->push_back(t);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    BOOST_CHECK_EQUAL(4000u, shared_vector.lockConst()->size());
+}
+#endif
+
+
+BOOST_AUTO_TEST_CASE(Version_bumped_by_writers_only)
+{
+    SharedResource<int, std::shared_mutex> shared_int(0);
+    const auto initial = shared_int.version();
+
+    shared_int.lockConst();
+    BOOST_CHECK_EQUAL(initial, shared_int.version());
+
+    {
+        auto shared_int_accessor = shared_int.lock();
+        *shared_int_accessor = 5;
+        BOOST_CHECK_EQUAL(initial, shared_int.version());
+    }
+    BOOST_CHECK_EQUAL(initial + 1, shared_int.version());
+
+    auto shared_int_accessor = shared_int.lock();
+    SharedResource<int, std::shared_mutex>::ConstAccessor shared_int_const_accessor(std::move(shared_int_accessor));
+    BOOST_CHECK_EQUAL(initial + 2, shared_int.version());
+}
+
+#if defined(__cpp_lib_atomic_wait)
+BOOST_AUTO_TEST_CASE(WaitChanged_wakes_on_write)
+{
+    SharedResource<std::string> shared_string("initial");
+    const auto initial = shared_string.version();
+
+    std::thread test_thread([&shared_string]()
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        shared_string.lockConst();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        *shared_string.lock() = "changed";
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    const auto changed = shared_string.waitChanged(initial);
+    BOOST_CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(100));
+    BOOST_CHECK(changed != initial);
+    BOOST_CHECK_EQUAL("changed", *shared_string.lockConst());
+
+    test_thread.join();
+}
+
+
+BOOST_AUTO_TEST_CASE(WaitFor_predicate)
+{
+    SharedResource<int> shared_int(0);
+
+    std::thread test_thread([&shared_int]()
+    {
+        for (int i = 0; i < 10; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            ++*shared_int.lock();
+        }
+    });
+
+    {
+        auto shared_int_accessor = shared_int.waitFor([](int value) { return value >= 5; });
+        BOOST_REQUIRE(shared_int_accessor.isValid());
+        BOOST_CHECK(*shared_int_accessor >= 5);
+    }
+
+    auto shared_int_accessor = shared_int.waitFor([](int value) { return value == 10; });
+    BOOST_CHECK_EQUAL(10, *shared_int_accessor);
+
+    test_thread.join();
+}
+#endif
+
+
+BOOST_AUTO_TEST_CASE(AtomicSharedResource_ops)
+{
+    SharedResource<std::atomic<int>> shared_int(5);
+
+    BOOST_CHECK_EQUAL(5, shared_int.load());
+    shared_int.store(7);
+    BOOST_CHECK_EQUAL(7, shared_int.exchange(10));
+    BOOST_CHECK_EQUAL(10, shared_int.fetch_add(2));
+    BOOST_CHECK_EQUAL(12, shared_int.fetch_sub(4));
+    BOOST_CHECK_EQUAL(8, shared_int.fetch_or(1));
+    BOOST_CHECK_EQUAL(9, shared_int.fetch_and(3));
+    BOOST_CHECK_EQUAL(1, shared_int.fetch_xor(3));
+    BOOST_CHECK_EQUAL(4, shared_int.update([](int value) { return value * 2; }));
+
+    int expected = 3;
+    BOOST_CHECK(!shared_int.compare_exchange_strong(expected, 0));
+    BOOST_CHECK_EQUAL(4, expected);
+    BOOST_CHECK(shared_int.compare_exchange_strong(expected, 0));
+
+    shared_int.lock()->store(42);
+    BOOST_CHECK_EQUAL(42, shared_int.lockConst()->load());
+    BOOST_CHECK_EQUAL(42, shared_int.load());
+}
+
+
+BOOST_AUTO_TEST_CASE(AtomicSharedResource_concurrent_update)
+{
+    SharedResource<std::atomic<long>> shared_long(0);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i)
+    {
+        threads.emplace_back([&shared_long]()
+        {
+            for (int j = 0; j < 10000; ++j)
+            {
+                shared_long.fetch_add(1, std::memory_order_relaxed);
+                shared_long.update([](long value) { return value + 2; });
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    BOOST_CHECK_EQUAL(4 * 10000 * 3, shared_long.load());
+}
+
+
+BOOST_AUTO_TEST_CASE(UpgradableAccessor_upgrade)
+{
+    SharedResource<std::unordered_map<int, std::string>, UpgradeMutex> shared_map;
+
+    auto upgradable = shared_map.lockUpgradable();
+    BOOST_REQUIRE(upgradable.isValid());
+    BOOST_CHECK(upgradable->empty());
+
+    std::thread test_thread([&shared_map]()
+    {
+        BOOST_CHECK(shared_map.tryLockConst().isValid());
+        BOOST_CHECK(!shared_map.tryLock().isValid());
+        BOOST_CHECK(!shared_map.tryLockUpgradable().isValid());
+    });
+    test_thread.join();
+
+    auto accessor = upgradable.upgrade();
+    BOOST_CHECK(!upgradable.isValid());
+    BOOST_REQUIRE(accessor.isValid());
+    accessor->emplace(1, "one");
+
+    test_thread = std::thread([&shared_map]()
+    {
+        BOOST_CHECK(!shared_map.tryLockConst().isValid());
+    });
+    test_thread.join();
+
+    SharedResource<std::unordered_map<int, std::string>, UpgradeMutex>::ConstAccessor const_accessor(std::move(accessor));
+    BOOST_CHECK_EQUAL("one", const_accessor->at(1));
+}
+
+
+BOOST_AUTO_TEST_CASE(Accessor_downgrade)
+{
+    SharedResource<std::string, UpgradeMutex> shared_string("initial");
+    const auto initial = shared_string.version();
+
+    auto accessor = shared_string.lock();
+    *accessor = "changed";
+    auto const_accessor = accessor.downgrade();
+    BOOST_CHECK(!accessor.isValid());
+    BOOST_REQUIRE(const_accessor.isValid());
+    BOOST_CHECK_EQUAL("changed", *const_accessor);
+    BOOST_CHECK_EQUAL(initial + 1, shared_string.version());
+
+    std::thread test_thread([&shared_string]()
+    {
+        auto other_accessor = shared_string.tryLockConst();
+        BOOST_CHECK(other_accessor.isValid());
+        BOOST_CHECK(!shared_string.tryLock().isValid());
+    });
+    test_thread.join();
+}
+
+
+BOOST_AUTO_TEST_CASE(Accessor_relaxIfContended)
+{
+    SharedResource<std::vector<int>> shared_vector;
+
+    auto accessor = shared_vector.lock();
+    accessor->push_back(1);
+    BOOST_CHECK(!accessor.relaxIfContended());
+
+    std::thread writer([&shared_vector]() { shared_vector.lock()->push_back(2); });
+
+    // The writer only gets in once it is blocked on the lock.
+    while (!accessor.relaxIfContended())
+    {
+        std::this_thread::yield();
+    }
+    writer.join();
+
+    BOOST_REQUIRE(accessor.isValid());
+    BOOST_CHECK(*accessor == std::vector<int>({1, 2}));
+}
+
+
+BOOST_AUTO_TEST_CASE(Accessor_relaxIfContended_sees_every_waiter)
+{
+    SharedResource<int, std::timed_mutex> shared_int(0);
+
+    auto accessor = shared_int.lock();
+    std::thread lock_all_waiter([&shared_int]() { ++*std::get<0>(lockAll(shared_int)); });
+    std::thread timed_waiter([&shared_int]()
+    {
+        auto timed_accessor = shared_int.tryLockFor(std::chrono::seconds(10));
+        BOOST_REQUIRE(timed_accessor.isValid());
+        ++*timed_accessor;
+    });
+
+    while (*accessor != 2)
+    {
+        accessor.relaxIfContended();
+    }
+    lock_all_waiter.join();
+    timed_waiter.join();
+
+    BOOST_CHECK(!accessor.relaxIfContended());
+}
+
+
+BOOST_AUTO_TEST_CASE(ConstAccessor_yield)
+{
+    SharedResource<int, std::shared_mutex> shared_int(1);
+
+    auto accessor = shared_int.lockConst();
+    BOOST_CHECK(!accessor.yield());
+    BOOST_REQUIRE(accessor.isValid());
+
+    std::atomic<bool> waiting{false};
+    std::thread writer([&shared_int, &waiting]()
+    {
+        waiting = true;
+        *shared_int.lock() = 2;
+    });
+
+    while (!waiting)
+    {
+        std::this_thread::yield();
+    }
+    while (*accessor != 2)
+    {
+        accessor.relaxIfContended();
+    }
+    writer.join();
+
+    BOOST_CHECK(!accessor.yield());
+    BOOST_CHECK_EQUAL(2, *accessor);
+}
+
+
+namespace
+{
+    std::atomic<bool> fail_locks{false};
+
+    // Fails every acquisition while fail_locks is set.
+    class ThrowingMutex
+    {
+    public:
+        void lock()
+        {
+            if (fail_locks)
+            {
+                throw std::runtime_error("lock failed");
+            }
+            m_mutex.lock();
+        }
+
+        bool try_lock()
+        {
+            if (fail_locks)
+            {
+                throw std::runtime_error("lock failed");
+            }
+            return m_mutex.try_lock();
+        }
+
+        void unlock()
+        {
+            m_mutex.unlock();
+        }
+
+    private:
+        std::mutex m_mutex;
+    };
+}
+
+
+BOOST_AUTO_TEST_CASE(Accessor_yield_invalid_after_throw)
+{
+    SharedResource<int, ThrowingMutex> shared_int(1);
+
+    auto accessor = shared_int.lock();
+    BOOST_REQUIRE(accessor.isValid());
+
+    fail_locks = true;
+    BOOST_CHECK_THROW(accessor.yield(), std::runtime_error);
+    fail_locks = false;
+
+    BOOST_CHECK(!accessor.isValid());
+    BOOST_CHECK(shared_int.tryLock().isValid());
+}
+
+
+BOOST_AUTO_TEST_CASE(UpgradableAccessor_insert_on_miss)
+{
+    SharedResource<std::unordered_map<int, int>, UpgradeMutex> shared_map;
+    std::atomic<int> inserts{0};
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i)
+    {
+        threads.emplace_back([&shared_map, &inserts]()
+        {
+            for (int key = 0; key < 1000; ++key)
+            {
+                auto upgradable = shared_map.lockUpgradable();
+                if (upgradable->count(key) == 0)
+                {
+                    auto accessor = upgradable.upgrade();
+                    accessor->emplace(key, key);
+                    ++inserts;
+                }
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    BOOST_CHECK_EQUAL(1000, inserts.load());
+    BOOST_CHECK_EQUAL(1000u, shared_map.lockConst()->size());
+}
+
+
+BOOST_AUTO_TEST_CASE(LeftRightSharedResource_modify)
+{
+    LeftRightSharedResource<std::vector<int>> shared_vector(3, 1);
+
+    BOOST_CHECK_EQUAL(3u, shared_vector.lockConst()->size());
+
+    int calls = 0;
+    shared_vector.modify([&calls](std::vector<int>& vector)
+    {
+        vector.push_back(2);
+        ++calls;
+    });
+    BOOST_CHECK_EQUAL(2, calls);
+
+    auto accessor = shared_vector.lockConst();
+    BOOST_REQUIRE(accessor.isValid());
+    BOOST_CHECK_EQUAL(4u, accessor->size());
+    BOOST_CHECK_EQUAL(2, accessor->back());
+    BOOST_CHECK_EQUAL(4u, shared_vector.read([](const std::vector<int>& vector) { return vector.size(); }));
+}
+
+
+BOOST_AUTO_TEST_CASE(LeftRightSharedResource_modify_throws)
+{
+    LeftRightSharedResource<std::vector<int>> shared_vector(3, 1);
+
+    // Reads both instances: the no-op modify moves readers to the other one.
+    auto sizes = [&shared_vector]()
+    {
+        const auto size = [](const std::vector<int>& vector) { return vector.size(); };
+        const auto first = shared_vector.read(size);
+        shared_vector.modify([](std::vector<int>&) {});
+        return std::make_pair(first, shared_vector.read(size));
+    };
+
+    int calls = 0;
+    auto push_then_throw = [&calls](int throw_on)
+    {
+        return [&calls, throw_on](std::vector<int>& vector)
+        {
+            vector.push_back(2);
+            if (++calls == throw_on)
+            {
+                throw std::runtime_error("modify failed");
+            }
+        };
+    };
+
+    BOOST_CHECK_THROW(shared_vector.modify(push_then_throw(1)), std::runtime_error);
+    BOOST_CHECK(std::make_pair(std::size_t(3), std::size_t(3)) == sizes());
+
+    calls = 0;
+    BOOST_CHECK_THROW(shared_vector.modify(push_then_throw(2)), std::runtime_error);
+    BOOST_CHECK(std::make_pair(std::size_t(4), std::size_t(4)) == sizes());
+}
+
+
+BOOST_AUTO_TEST_CASE(LeftRightSharedResource_readers_see_consistent_state)
+{
+    LeftRightSharedResource<std::vector<int>> shared_vector(64, 0);
+    std::atomic<bool> done{false};
+    std::atomic<int> inconsistent{0};
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; ++i)
+    {
+        readers.emplace_back([&]()
+        {
+            while (!done.load())
+            {
+                auto accessor = shared_vector.lockConst();
+                for (auto value : *accessor)
+                {
+                    if (value != accessor->front())
+                    {
+                        ++inconsistent;
+                        break;
+                    }
+                }
+            }
+        });
+    }
+
+    for (int i = 1; i <= 1000; ++i)
+    {
+        shared_vector.modify([i](std::vector<int>& vector)
+        {
+            for (auto& value : vector)
+            {
+                value = i;
+            }
+        });
+    }
+    done = true;
+
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+
+    BOOST_CHECK_EQUAL(0, inconsistent.load());
+    BOOST_CHECK_EQUAL(1000, shared_vector.lockConst()->front());
+}
+
+
+BOOST_AUTO_TEST_CASE(Defer_merged_on_lock)
+{
+    SharedResource<std::unordered_map<std::string, int>> shared_map;
+
+    shared_map.defer([](std::unordered_map<std::string, int>& map) { ++map["first"]; });
+    shared_map.defer([](std::unordered_map<std::string, int>& map) { ++map["first"]; });
+    BOOST_CHECK_EQUAL(0u, shared_map.version());
+
+    BOOST_CHECK_EQUAL(2, shared_map.lockConst()->at("first"));
+
+    shared_map.defer([](std::unordered_map<std::string, int>& map) { ++map["second"]; });
+    BOOST_CHECK_EQUAL(1, shared_map.lock()->at("second"));
+}
+
+
+BOOST_AUTO_TEST_CASE(Defer_merged_on_every_read_path)
+{
+    SharedResource<int, std::shared_timed_mutex> shared_int(0);
+    const auto& const_int = shared_int;
+    auto increment = [](int& value) { ++value; };
+
+    shared_int.defer(increment);
+    BOOST_CHECK_EQUAL(1, *shared_int.tryLockConst());
+
+    shared_int.defer(increment);
+    BOOST_CHECK_EQUAL(2, *shared_int.tryLockConstFor(std::chrono::milliseconds(10)));
+
+    shared_int.defer(increment);
+    BOOST_CHECK_EQUAL(3, *shared_int.tryLockConstUntil(std::chrono::steady_clock::now() +
+                                                       std::chrono::milliseconds(10)));
+
+#if defined(__cpp_lib_jthread)
+    shared_int.defer(increment);
+    shared_int.defer(increment);
+    BOOST_CHECK_EQUAL(5, *shared_int.tryLockConstFor(std::chrono::milliseconds(10), std::stop_token()));
+    *shared_int.lock() = 3;
+#endif
+
+    shared_int.defer(increment);
+    BOOST_CHECK_EQUAL(4, *std::get<0>(lockAll(const_int)));
+
+    shared_int.defer(increment);
+    BOOST_CHECK_EQUAL(5, *std::get<0>(tryLockAll(const_int)));
+
+    shared_int.defer(increment);
+    BOOST_CHECK_EQUAL(6, *std::get<0>(tryLockAllFor(std::chrono::milliseconds(10), const_int)));
+
+    SharedResource<int, UpgradeMutex> upgradable_int(0);
+
+    upgradable_int.defer(increment);
+    BOOST_CHECK_EQUAL(1, *upgradable_int.lockUpgradable());
+
+    upgradable_int.defer(increment);
+    BOOST_CHECK_EQUAL(2, *upgradable_int.tryLockUpgradable());
+}
+
+
+BOOST_AUTO_TEST_CASE(Defer_merge_keeps_reads_shared)
+{
+    SharedResource<int, std::shared_mutex> shared_int(0);
+    auto increment = [](int& value) { ++value; };
+
+    shared_int.defer(increment);
+    auto accessor = shared_int.lockConst();
+    BOOST_CHECK_EQUAL(1, *accessor);
+    std::thread([&shared_int]() { BOOST_CHECK(shared_int.tryLockConst().isValid()); }).join();
+
+    shared_int.defer(increment);
+    std::thread([&shared_int]()
+    {
+        auto other = shared_int.tryLockConst();
+        BOOST_CHECK(!other.isValid());
+    }).join();
+}
+
+
+BOOST_AUTO_TEST_CASE(Defer_drained_at_threshold)
+{
+    SharedResource<int> shared_int(0);
+
+    for (int i = 0; i < 64; ++i)
+    {
+        shared_int.defer([](int& value) { ++value; });
+    }
+    BOOST_CHECK_EQUAL(1u, shared_int.version());
+
+    shared_int.defer([](int& value) { value *= 2; });
+    BOOST_CHECK_EQUAL(128, shared_int.load());
+}
+
+
+BOOST_AUTO_TEST_CASE(Defer_concurrent_counters)
+{
+    SharedResource<long> shared_long(0);
+
+    {
+        SharedResource<long> destroyed_long(0);
+        destroyed_long.defer([](long& value) { ++value; });
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i)
+    {
+        threads.emplace_back([&shared_long]()
+        {
+            for (int j = 0; j < 10000; ++j)
+            {
+                shared_long.defer([](long& value) { ++value; });
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    shared_long.flush();
+    BOOST_CHECK_EQUAL(4 * 10000, *shared_long.lockConst());
+}
+
+
+BOOST_AUTO_TEST_CASE(Post_drained_by_releaser)
+{
+    SharedResource<std::vector<int>> shared_vector;
+
+    shared_vector.post([](std::vector<int>& vector) { vector.push_back(1); });
+    BOOST_CHECK_EQUAL(1u, shared_vector.lockConst()->size());
+
+    std::atomic<bool> locked{false};
+    std::atomic<bool> posted{false};
+    std::thread holder([&]()
+    {
+        auto accessor = shared_vector.lock();
+        locked = true;
+        while (!posted)
+        {
+            std::this_thread::yield();
+        }
+        accessor->push_back(2);
+    });
+
+    while (!locked)
+    {
+        std::this_thread::yield();
+    }
+    shared_vector.post([](std::vector<int>& vector) { vector.push_back(3); });
+    shared_vector.post([](std::vector<int>& vector) { vector.push_back(4); });
+    posted = true;
+    holder.join();
+
+    BOOST_CHECK(*shared_vector.lockConst() == std::vector<int>({1, 2, 3, 4}));
+}
+
+
+BOOST_AUTO_TEST_CASE(Post_drained_only_by_outermost_writer)
+{
+    SharedResource<int, std::recursive_mutex> shared_int(0);
+    {
+        auto outer = shared_int.lock();
+        std::thread([&shared_int]() { shared_int.post([](int& value) { value = 1; }); }).join();
+        shared_int.lock();
+        BOOST_CHECK_EQUAL(0, *outer);
+    }
+    BOOST_CHECK_EQUAL(1, shared_int.load());
+
+    SharedResource<int, std::shared_mutex> shared_reader(0);
+    {
+        auto reader = shared_reader.lockConst();
+        std::thread([&shared_reader]() { shared_reader.post([](int& value) { value = 1; }); }).join();
+    }
+    BOOST_CHECK_EQUAL(0, *shared_reader.lockConst());
+    shared_reader.flush();
+    BOOST_CHECK_EQUAL(1, *shared_reader.lockConst());
+}
+
+
+BOOST_AUTO_TEST_CASE(Post_drain_is_bounded)
+{
+    SharedResource<int> shared_int(0);
+    std::atomic<bool> stop{false};
+
+    // Posts itself again until stopped, so an unbounded drain never returns.
+    std::function<void(int&)> repost = [&shared_int, &stop, &repost](int& value)
+    {
+        ++value;
+        if (!stop)
+        {
+            shared_int.post(repost);
+        }
+    };
+
+    shared_int.post(repost);
+    BOOST_CHECK_GT(shared_int.load(), 0);
+    stop = true;
+    shared_int.flush();
+    BOOST_CHECK(shared_int.tryLock().isValid());
+}
+
+
+BOOST_AUTO_TEST_CASE(Submit_returns_result)
+{
+    SharedResource<int> shared_int(1);
+
+    auto doubled = shared_int.submit([](int& value) { return value *= 2; });
+    auto failed = shared_int.submit([](int&) { throw std::runtime_error("failed"); });
+    auto unique = shared_int.submit([result = std::make_unique<int>(5)](int& value) { value += *result; });
+
+    BOOST_CHECK_EQUAL(2, doubled.get());
+    BOOST_CHECK_THROW(failed.get(), std::runtime_error);
+    unique.get();
+    BOOST_CHECK_EQUAL(7, shared_int.load());
+}
+
+
+BOOST_AUTO_TEST_CASE(Post_concurrent_with_executor)
+{
+    SharedResource<std::vector<int>> shared_vector;
+    SharedQueue<std::function<void()>> executor_queue;
+    std::thread executor([&executor_queue]()
+    {
+        while (auto task = executor_queue.pop())
+        {
+            (*task)();
+        }
+    });
+    shared_vector.setExecutor([&executor_queue](std::function<void()> task) { executor_queue.push(std::move(task)); });
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i)
+    {
+        threads.emplace_back([&shared_vector, i]()
+        {
+            for (int j = 0; j < 1000; ++j)
+            {
+                shared_vector.post([i, j](std::vector<int>& vector) { vector.push_back(i * 1000 + j); });
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    auto size = shared_vector.submit([](std::vector<int>& vector) { return vector.size(); });
+    BOOST_CHECK_EQUAL(4 * 1000u, size.get());
+    executor_queue.close();
+    executor.join();
+
+    // Posts from one thread keep their order.
+    std::vector<int> last(4, -1);
+    for (auto value : *shared_vector.lockConst())
+    {
+        BOOST_CHECK_LT(last[value / 1000], value % 1000);
+        last[value / 1000] = value % 1000;
+    }
+}
+
+
+namespace
+{
+    template<typename Mutex>
+    void checkQueueMutex()
+    {
+        Mutex mutex;
+        BOOST_CHECK(mutex.try_lock());
+        std::thread([&mutex]() { BOOST_CHECK(!mutex.try_lock()); }).join();
+        mutex.unlock();
+
+        SharedResource<long long, Mutex> shared_counter(0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&shared_counter]()
+            {
+                for (int i = 0; i < 5000; ++i)
+                {
+                    ++*shared_counter.lock();
+                }
+            });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        BOOST_CHECK_EQUAL(20000, *shared_counter.lockConst());
+
+        std::condition_variable_any condvar;
+        std::thread test_thread([&shared_counter, &condvar]()
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            *shared_counter.lock() = 7;
+            condvar.notify_all();
+        });
+
+        auto shared_counter_accessor = shared_counter.lock();
+        bool wait_res = shared_counter_accessor.waitFor(condvar, std::chrono::seconds(10),
+                                                        [&shared_counter_accessor] { return *shared_counter_accessor == 7; });
+        BOOST_CHECK(wait_res);
+        test_thread.join();
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(TicketMutex_with_SharedResource)
+{
+    checkQueueMutex<TicketMutex>();
+}
+
+
+BOOST_AUTO_TEST_CASE(TicketMutex_is_fifo)
+{
+    TicketMutex mutex;
+    std::vector<int> order;
+
+    mutex.lock();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 3; ++t)
+    {
+        threads.emplace_back([&mutex, &order, t]()
+        {
+            mutex.lock();
+            order.push_back(t);
+            mutex.unlock();
+        });
+        while (mutex.waiting() != static_cast<std::uint32_t>(t + 1))
+        {
+            std::this_thread::yield();
+        }
+    }
+    mutex.unlock();
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    BOOST_CHECK((order == std::vector<int>{0, 1, 2}));
+}
+
+
+BOOST_AUTO_TEST_CASE(ClhMutex_with_SharedResource)
+{
+    checkQueueMutex<ClhMutex>();
+}
+
+
+BOOST_AUTO_TEST_CASE(ClhMutex_try_lock_while_threads_exit)
+{
+    // Released nodes move to other threads and die with them, so try_lock()
+    // must not look at whatever node it finds at the tail.
+    ClhMutex mutex;
+    std::atomic<bool> done{false};
+    std::thread prober([&mutex, &done]()
+    {
+        while (!done.load())
+        {
+            if (mutex.try_lock())
+            {
+                mutex.unlock();
+            }
+        }
+    });
+
+    for (int round = 0; round < 200; ++round)
+    {
+        std::thread([&mutex]()
+        {
+            for (int i = 0; i < 10; ++i)
+            {
+                mutex.lock();
+                mutex.unlock();
+            }
+        }).join();
+    }
+    done = true;
+    prober.join();
+
+    BOOST_CHECK(mutex.try_lock());
+    mutex.unlock();
+}
+
+
+BOOST_AUTO_TEST_CASE(CohortMutex_with_SharedResource)
+{
+    checkQueueMutex<CohortMutex<>>();
+    checkQueueMutex<CohortMutex<1>>();
+}
+
+
+BOOST_AUTO_TEST_CASE(CohortMutex_cpu_grouping)
+{
+    BOOST_CHECK(CohortMutex<1>::cohortIndex() < CohortMutex<1>::maxCohorts);
+    BOOST_CHECK_EQUAL(CohortMutex<1024>::cohortIndex(), CohortMutex<1024>::cohortIndex());
+}
+
+
+BOOST_AUTO_TEST_CASE(Combinable_local_and_combine)
+{
+    Combinable<int> combinable_int(0);
+
+    *combinable_int.local() += 2;
+    *combinable_int.local() += 3;
+    BOOST_CHECK_EQUAL(5, *combinable_int.local());
+
+    std::thread([&combinable_int]() { *combinable_int.local() += 10; }).join();
+
+    auto combined = combinable_int.combine([](int& sum, int value) { sum += value; });
+    BOOST_CHECK_EQUAL(15, *combined);
+
+    auto maximum = combinable_int.combine([](int& result, int value) { result = std::max(result, value); });
+    BOOST_CHECK_EQUAL(10, *maximum);
+}
+
+
+BOOST_AUTO_TEST_CASE(Combinable_concurrent_histogram)
+{
+    Combinable<std::unordered_map<int, long>> combinable_histogram;
+    std::atomic<bool> done{false};
+
+    std::thread reader([&combinable_histogram, &done]()
+    {
+        while (!done.load())
+        {
+            auto histogram = combinable_histogram.combine([](std::unordered_map<int, long>& result,
+                                                             const std::unordered_map<int, long>& replica)
+            {
+                for (auto& bucket : replica)
+                {
+                    result[bucket.first] += bucket.second;
+                }
+            });
+            BOOST_CHECK(histogram->size() <= 10u);
+        }
+    });
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&combinable_histogram]()
+        {
+            for (int i = 0; i < 10000; ++i)
+            {
+                ++(*combinable_histogram.local())[i % 10];
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    done = true;
+    reader.join();
+
+    auto histogram = combinable_histogram.combine([](std::unordered_map<int, long>& result,
+                                                     const std::unordered_map<int, long>& replica)
+    {
+        for (auto& bucket : replica)
+        {
+            result[bucket.first] += bucket.second;
+        }
+    });
+    BOOST_CHECK_EQUAL(10u, histogram->size());
+    BOOST_CHECK_EQUAL(4000, histogram->at(3));
+}
+
+
+namespace
+{
+    struct Composite
+    {
+        std::string name;
+        std::vector<int> values;
+    };
+}
+
+
+BOOST_AUTO_TEST_CASE(Accessor_map)
+{
+    SharedResource<Composite> shared_composite(Composite{"initial", {1, 2}});
+
+    auto name_accessor = shared_composite.lock().map(&Composite::name);
+    BOOST_REQUIRE(name_accessor.isValid());
+    *name_accessor = "changed";
+    BOOST_CHECK_EQUAL(7u, name_accessor->size());
+
+    std::thread([&shared_composite]() { BOOST_CHECK(!shared_composite.tryLock().isValid()); }).join();
+
+    auto moved_accessor = std::move(name_accessor);
+    BOOST_CHECK(!name_accessor.isValid());
+    BOOST_CHECK(moved_accessor.isValid());
+    moved_accessor = decltype(moved_accessor)(std::move(name_accessor));
+    BOOST_CHECK(!moved_accessor.isValid());
+
+    BOOST_CHECK_EQUAL("changed", shared_composite.load().name);
+
+    auto first = shared_composite.lockConst()
+        .map(&Composite::values)
+        .map([](const std::vector<int>& values) -> const int& { return values.front(); });
+    BOOST_CHECK_EQUAL(1, *first);
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedFields_parallel_fields)
+{
+    SharedFields<int, std::string, std::vector<int>> shared_fields(1, std::string("name"), std::vector<int>{1});
+
+    static_assert(decltype(shared_fields)::fieldCount() == 3, "three fields");
+    BOOST_CHECK_EQUAL(1, *shared_fields.lockConst<0>());
+
+    {
+        auto int_accessor = shared_fields.lock<0>();
+        std::thread([&shared_fields]()
+        {
+            auto string_accessor = shared_fields.field<1>().tryLock();
+            BOOST_CHECK(string_accessor.isValid());
+            BOOST_CHECK(!shared_fields.field<0>().tryLock().isValid());
+        }).join();
+        *int_accessor = 2;
+    }
+
+    auto accessors = shared_fields.lockFields<0, 2>();
+    std::get<1>(accessors)->push_back(*std::get<0>(accessors));
+    BOOST_CHECK_EQUAL(2u, std::get<1>(accessors)->size());
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedQueue_push_pop)
+{
+    SharedQueue<std::unique_ptr<int>> shared_queue;
+
+    BOOST_CHECK(shared_queue.push(std::make_unique<int>(1)));
+    BOOST_CHECK(shared_queue.tryPush(std::make_unique<int>(2)));
+    BOOST_CHECK_EQUAL(2u, shared_queue.size());
+
+    auto value = shared_queue.pop();
+    BOOST_REQUIRE(value.has_value());
+    BOOST_CHECK_EQUAL(1, **value);
+
+    std::vector<std::unique_ptr<int>> batch;
+    batch.push_back(std::make_unique<int>(3));
+    batch.push_back(std::make_unique<int>(4));
+    BOOST_CHECK_EQUAL(2u, shared_queue.pushN(std::make_move_iterator(batch.begin()),
+                                             std::make_move_iterator(batch.end())));
+
+    std::vector<std::unique_ptr<int>> popped;
+    BOOST_CHECK_EQUAL(3u, shared_queue.popN(std::back_inserter(popped), 10));
+    BOOST_CHECK_EQUAL(2, *popped[0]);
+    BOOST_CHECK_EQUAL(4, *popped[2]);
+    BOOST_CHECK(!shared_queue.tryPop().has_value());
+    BOOST_CHECK_EQUAL(0u, shared_queue.popN(std::back_inserter(popped), 0));
+
+    shared_queue.close();
+    BOOST_CHECK(shared_queue.isClosed());
+    BOOST_CHECK(!shared_queue.push(std::make_unique<int>(5)));
+    BOOST_CHECK(!shared_queue.pop().has_value());
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedQueue_bounded)
+{
+    SharedQueue<int> shared_queue(2);
+
+    BOOST_CHECK(shared_queue.tryPush(1));
+    BOOST_CHECK(shared_queue.tryPush(2));
+    BOOST_CHECK(!shared_queue.tryPush(3));
+
+    std::thread test_thread([&shared_queue]()
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        BOOST_CHECK_EQUAL(1, shared_queue.pop().value_or(0));
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    BOOST_CHECK(shared_queue.push(3));
+    BOOST_CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(50));
+    test_thread.join();
+
+    BOOST_CHECK_EQUAL(2u, shared_queue.size());
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedQueue_producers_consumers)
+{
+    SharedQueue<int> shared_queue(64);
+    std::atomic<long> sum{0};
+    std::atomic<int> count{0};
+
+    std::vector<std::thread> consumers;
+    for (int t = 0; t < 2; ++t)
+    {
+        consumers.emplace_back([&]()
+        {
+            std::vector<int> batch;
+            while (shared_queue.popN(std::back_inserter(batch), 16) != 0)
+            {
+                for (auto value : batch)
+                {
+                    sum += value;
+                }
+                count += static_cast<int>(batch.size());
+                batch.clear();
+            }
+        });
+    }
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 3; ++t)
+    {
+        producers.emplace_back([&shared_queue]()
+        {
+            std::vector<int> batch(10, 1);
+            for (int i = 0; i < 1000; ++i)
+            {
+                if (i % 2)
+                {
+                    shared_queue.pushN(batch.begin(), batch.end());
+                }
+                else
+                {
+                    for (auto value : batch)
+                    {
+                        shared_queue.push(value);
+                    }
+                }
+            }
+        });
+    }
+
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+    shared_queue.close();
+    for (auto& consumer : consumers)
+    {
+        consumer.join();
+    }
+
+    BOOST_CHECK_EQUAL(30000, count.load());
+    BOOST_CHECK_EQUAL(30000, sum.load());
+}
+
+
+namespace
+{
+    template<typename Array>
+    void checkSharedResourceArray(Array& shared_array)
+    {
+        BOOST_CHECK_EQUAL(8u, shared_array.size());
+        BOOST_CHECK_EQUAL(5, *shared_array.lockConst(7));
+
+        {
+            auto accessor = shared_array.lock(3);
+            std::thread([&shared_array]()
+            {
+                BOOST_CHECK(!shared_array.tryLock(3).isValid());
+                BOOST_CHECK(shared_array.tryLock(4).isValid());
+            }).join();
+        }
+
+        std::vector<std::thread> threads;
+        for (std::size_t t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&shared_array, t]()
+            {
+                for (int i = 0; i < 10000; ++i)
+                {
+                    ++*shared_array.lock(t);
+                    ++*shared_array.lock(t + 4);
+                }
+            });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        for (std::size_t i = 0; i < shared_array.size(); ++i)
+        {
+            BOOST_CHECK_EQUAL(10005, *shared_array.lockConst(i));
+        }
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedResourceArray_interleaved)
+{
+    SharedResourceArray<int> shared_array(8, 5);
+    checkSharedResourceArray(shared_array);
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedResourceArray_split)
+{
+    SharedResourceArray<int, std::shared_mutex, ArrayLayout::Split> shared_array(8, 5);
+    checkSharedResourceArray(shared_array);
+
+    auto first = shared_array.lockConst(0);
+    auto second = shared_array.lockConst(0);
+    BOOST_CHECK(first.isValid() && second.isValid());
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedResourceArray_strings)
+{
+    SharedResourceArray<std::string, std::mutex, ArrayLayout::Split> shared_array(3, std::string("slot"));
+    *shared_array.lock(1) += "1";
+    BOOST_CHECK_EQUAL("slot1", *shared_array.lockConst(1));
+    BOOST_CHECK_EQUAL("slot", *shared_array.lockConst(2));
+
+    SharedResourceArray<std::string> empty_array(0);
+    BOOST_CHECK_EQUAL(0u, empty_array.size());
+}
+
+
+namespace
+{
+    struct LookupTable
+    {
+        int version;
+        int values[64];
+    };
+}
+
+
+BOOST_AUTO_TEST_CASE(InterprocessSharedResource_named)
+{
+    const auto name = "/shared-resource-test-" + std::to_string(getpid());
+    InterprocessSharedResource<LookupTable> creator(name.c_str(), LookupTable{1, {}});
+    InterprocessSharedResource<LookupTable> attached(name.c_str(), LookupTable{2, {}});
+
+    BOOST_CHECK_EQUAL(1, attached.lockConst()->version);
+    creator.lock()->values[3] = 42;
+    BOOST_CHECK_EQUAL(42, attached.lockConst()->values[3]);
+
+    {
+        auto accessor = creator.lock();
+        BOOST_CHECK(!accessor.ownerDied());
+        std::thread([&attached]() { BOOST_CHECK(!attached.tryLock().isValid()); }).join();
+    }
+
+    BOOST_CHECK(InterprocessSharedResource<LookupTable>::remove(name.c_str()));
+    BOOST_CHECK(!InterprocessSharedResource<LookupTable>::remove(name.c_str()));
+}
+
+
+BOOST_AUTO_TEST_CASE(InterprocessSharedResource_creator_died)
+{
+    const auto name = "/shared-resource-died-" + std::to_string(getpid());
+
+    // The child gets as far as sizing the segment and dies before T exists.
+    const pid_t child = fork();
+    if (child == 0)
+    {
+        const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+        flock(fd, LOCK_EX);
+        const bool sized = ftruncate(fd, 4096) == 0;
+        _exit(sized ? 0 : 1);
+    }
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    BOOST_REQUIRE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    InterprocessSharedResource<long> shared_long(name.c_str(), 7L);
+    BOOST_CHECK_EQUAL(7L, *shared_long.lockConst());
+    BOOST_CHECK(InterprocessSharedResource<long>::remove(name.c_str()));
+}
+
+
+BOOST_AUTO_TEST_CASE(InterprocessSharedResource_across_processes)
+{
+    InterprocessSharedResource<long> shared_long(nullptr, 0L);
+
+    std::vector<pid_t> children;
+    for (int c = 0; c < 2; ++c)
+    {
+        const pid_t child = fork();
+        if (child == 0)
+        {
+            for (int i = 0; i < 10000; ++i)
+            {
+                ++*shared_long.lock();
+            }
+            _exit(0);
+        }
+        children.push_back(child);
+    }
+
+    for (int i = 0; i < 10000; ++i)
+    {
+        ++*shared_long.lock();
+    }
+
+    for (auto child : children)
+    {
+        int status = 0;
+        waitpid(child, &status, 0);
+        BOOST_CHECK(WIFEXITED(status));
+    }
+
+    BOOST_CHECK_EQUAL(30000, *shared_long.lockConst());
+}
+
+
+BOOST_AUTO_TEST_CASE(InterprocessSharedResource_owner_died)
+{
+    InterprocessSharedResource<LookupTable> shared_table(nullptr, LookupTable{1, {}});
+
+    const pid_t child = fork();
+    if (child == 0)
+    {
+        auto accessor = shared_table.lock();
+        accessor->version = -1;
+        _exit(0);
+    }
+
+    int status = 0;
+    waitpid(child, &status, 0);
+
+    {
+        auto accessor = shared_table.lock();
+        BOOST_REQUIRE(accessor.isValid());
+        BOOST_CHECK(accessor.ownerDied());
+        BOOST_CHECK_EQUAL(-1, accessor->version);
+        accessor->version = 2;
+        accessor.markConsistent();
+        BOOST_CHECK(!accessor.ownerDied());
+    }
+
+    auto accessor = shared_table.lock();
+    BOOST_CHECK(!accessor.ownerDied());
+    BOOST_CHECK_EQUAL(2, accessor->version);
+}